@@ -0,0 +1,52 @@
+"""Benchmarks for local BRDF correction."""
+
+import numpy as np
+import pytest
+
+from earthlib import BRDFCorrect
+
+SENSORS = ["Landsat7", "Landsat8", "Sentinel2"]
+CORNERS = BRDFCorrect.footprintCorners(
+    [(-120.2, 37.1), (-118.0, 36.7), (-118.4, 35.0), (-120.6, 35.4)]
+)
+TIME_START = 1593619200000  # 2020-07-01 16:00 UTC
+
+
+def sceneGeometry(shape: tuple) -> dict:
+    """Returns the kernelGrids() keyword arguments for a tile over the footprint"""
+    return {
+        "lon": np.linspace(-120.4, -118.2, shape[1])[np.newaxis, :],
+        "lat": np.linspace(36.9, 35.2, shape[0])[:, np.newaxis],
+        "time_start": TIME_START,
+        "corners": CORNERS,
+    }
+
+
+@pytest.mark.parametrize("sensor", SENSORS)
+def test_brdfCorrectLocal(throughput, tiles, sensor):
+    coefficients = BRDFCorrect.getCoefficients(sensor)
+    bands = {name: band for name, band in tiles(sensor).items() if name in coefficients}
+    shape = next(iter(bands.values())).shape
+    geometry = sceneGeometry(shape)
+    n_pixels = shape[0] * shape[1] * len(bands)
+
+    # kernels are cached after the first call, so this measures the per-band work
+    throughput(
+        BRDFCorrect.brdfCorrectLocal,
+        n_pixels,
+        "pixels",
+        bands,
+        coefficientsByBand=coefficients,
+        **geometry,
+    )
+
+
+def test_kernelGrids(benchmark, tiles):
+    shape = next(iter(tiles("Landsat8").values())).shape
+    geometry = sceneGeometry(shape)
+    benchmark.pedantic(
+        BRDFCorrect.kernelGrids,
+        kwargs=dict(shape=shape, **geometry),
+        setup=BRDFCorrect.clearKernelCache,
+        rounds=20,
+    )
@@ -0,0 +1,82 @@
+"""Checks that the local kernels match the earth engine functions on sample pixels.
+
+Requires an authenticated earth engine session, and is skipped otherwise. Each sample
+    pixel is a constant ee.Image, so only a few values are computed server-side.
+"""
+
+import ee
+import numpy as np
+import pytest
+
+from earthlib import NIRv, Scale, SoilPVNPV
+from earthlib.config import RMSE
+from earthlib.Unmix import fractionalCover, fractionalCoverLocal
+from earthlib.utils import endmemberArray, getBands, sampleEndmembers
+
+SENSORS = ["Landsat8", "Sentinel2"]
+N_SAMPLES = 8
+POINT = [-120.0, 36.0]
+
+
+@pytest.fixture(scope="module")
+def session():
+    try:
+        ee.Initialize()
+    except Exception:
+        pytest.skip("earth engine is not authenticated")
+
+
+def samplePixels(images: list, scale: float = 30) -> list:
+    """Computes the band values of constant images in a single request"""
+    point = ee.Geometry.Point(POINT)
+    samples = ee.List(
+        [image.reduceRegion(ee.Reducer.first(), point, scale) for image in images]
+    )
+    return samples.getInfo()
+
+
+def constantImages(pixels: np.ndarray, bands: list) -> list:
+    """Creates one constant image per (n_bands,) pixel"""
+    return [ee.Image.constant(pixel.tolist()).rename(bands) for pixel in pixels]
+
+
+@pytest.mark.parametrize("sensor", SENSORS)
+def test_scaleNIRv(session, sensor):
+    rng = np.random.default_rng(0)
+    bands = getBands(sensor)
+    scale, offset = Scale.getScaleParams(sensor)
+    reflectance = rng.uniform(0.02, 0.6, size=(N_SAMPLES, len(bands)))
+    dn = np.rint((reflectance - offset) / scale)
+
+    scaleImage, nirvImage = Scale.bySensor(sensor), NIRv.bySensor(sensor)
+    images = [nirvImage(scaleImage(image)) for image in constantImages(dn, bands)]
+    remote = samplePixels(images)
+
+    scaled = Scale.scaleLocal(dn, scale, offset, dtype=np.float64)
+    red, nir = (bands.index(band) for band in NIRv.getNIRvBands(sensor))
+    nirv = NIRv.NIRvLocal(scaled[:, red], scaled[:, nir])
+    for i, values in enumerate(remote):
+        assert np.allclose([values[band] for band in bands], scaled[i], atol=1e-6)
+        assert np.isclose(values["NIRv"], nirv[i], atol=1e-5)
+
+
+@pytest.mark.parametrize("sensor", SENSORS)
+def test_fractionalCover(session, sensor):
+    rng = np.random.default_rng(0)
+    bands = getBands(sensor)
+    endmembers = sampleEndmembers(["bare", "vegetation", "npv"], sensor, 5, seed=0)
+    fractions = rng.dirichlet(np.ones(4), size=N_SAMPLES)[:, :3]
+    pixels = fractions @ endmembers[0]
+
+    names = SoilPVNPV.ENDMEMBER_NAMES
+    images = [
+        fractionalCover(image, endmemberArray(endmembers), names)
+        for image in constantImages(pixels, bands)
+    ]
+    remote = samplePixels(images)
+
+    local = fractionalCoverLocal(pixels.T, endmembers)
+    for i, values in enumerate(remote):
+        expected = local[:, i]
+        assert np.allclose([values[name] for name in names], expected[:-1], atol=1e-3)
+        assert np.isclose(values[RMSE], expected[-1], atol=1e-3)
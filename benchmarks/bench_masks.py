@@ -0,0 +1,23 @@
+"""Benchmarks for QA band decoding and morphological opening."""
+
+import pytest
+
+from earthlib.CloudMask import openingLocal, qaMaskLocal
+from earthlib.config import QA_RULES
+
+RADII = [1, 4, 9, 25]
+
+
+@pytest.mark.parametrize("sensor", list(QA_RULES.keys()))
+@pytest.mark.parametrize("pack", [False, True])
+def test_qaMaskLocal(throughput, tiles, sensor, pack):
+    bands = tiles(sensor)
+    n_pixels = next(iter(bands.values())).size
+    throughput(qaMaskLocal, n_pixels, "pixels", bands, sensor, pack)
+
+
+@pytest.mark.parametrize("radius", RADII)
+@pytest.mark.parametrize("kernel", ["circle", "square"])
+def test_openingLocal(throughput, tiles, radius, kernel):
+    mask = qaMaskLocal(tiles("Landsat8"), "Landsat8", pack=False)
+    throughput(openingLocal, mask.size, "pixels", mask, radius=radius, kernel=kernel)
@@ -0,0 +1,24 @@
+"""Benchmarks for resampling the spectral library to sensor bands."""
+
+import pytest
+
+from earthlib.config import collections
+from earthlib.utils import (
+    getEndmemberLibrary,
+    resampleSpectra,
+    selectSpectra,
+    sensorResponse,
+)
+
+
+@pytest.mark.parametrize("sensor", list(collections.keys()))
+def test_resampleSpectra(throughput, sensor):
+    spectra = getEndmemberLibrary().spectra.spectra
+    response = sensorResponse(sensor)
+    throughput(resampleSpectra, len(spectra), "spectra", spectra, response)
+
+
+@pytest.mark.parametrize("sensor", ["Landsat8", "Sentinel2"])
+def test_selectSpectra(throughput, sensor):
+    n_spectra = len(selectSpectra("vegetation", sensor, n=0))
+    throughput(selectSpectra, n_spectra, "spectra", "vegetation", sensor, 0)
@@ -0,0 +1,46 @@
+"""Benchmarks for local FCLS unmixing by endmember and band count."""
+
+import numpy as np
+import pytest
+
+from earthlib.Unmix import fractionalCoverLocal
+from earthlib.utils import sampleEndmembers
+
+# sensors with 4, 6 and 10 reflectance bands
+SENSORS = {4: "PlanetScope", 6: "Landsat8", 10: "Sentinel2"}
+TYPES = {
+    3: ["bare", "vegetation", "npv"],
+    4: ["bare", "vegetation", "npv", "urban"],
+}
+UNMIX_SHAPE = (256, 256)
+N_DRAWS = 10
+
+
+def mixedPixels(endmembers: np.ndarray, shape: tuple, seed: int = 0) -> np.ndarray:
+    """Simulates reflectance as random mixtures of endmembers and shade.
+
+    Args:
+        endmembers: an (n_draws, n_classes, n_bands) array (from sampleEndmembers()).
+        shape: the (rows, cols) shape of the tile.
+        seed: the random seed.
+
+    Returns:
+        a float32 array of shape (n_bands, rows, cols).
+    """
+    rng = np.random.default_rng(seed)
+    n_pixels = shape[0] * shape[1]
+    _, n_classes, n_bands = endmembers.shape
+    fractions = rng.dirichlet(np.ones(n_classes + 1), size=n_pixels)[:, :n_classes]
+    pixels = fractions @ endmembers[0]
+    pixels += rng.normal(0, 0.005, size=pixels.shape)
+    return np.ascontiguousarray(pixels.T.reshape((n_bands,) + shape), dtype=np.float32)
+
+
+@pytest.mark.parametrize("n_bands", list(SENSORS.keys()))
+@pytest.mark.parametrize("n_endmembers", list(TYPES.keys()))
+def test_fractionalCoverLocal(throughput, n_endmembers, n_bands):
+    sensor = SENSORS[n_bands]
+    endmembers = sampleEndmembers(TYPES[n_endmembers], sensor, N_DRAWS, seed=0)
+    reflectance = mixedPixels(endmembers, UNMIX_SHAPE)
+    n_pixels = UNMIX_SHAPE[0] * UNMIX_SHAPE[1]
+    throughput(fractionalCoverLocal, n_pixels, "pixels", reflectance, endmembers)
@@ -0,0 +1,78 @@
+"""
+A script to compare the earth engine graph size and client build time of the per-draw
+(ee.List) and single-array (ee.Array) unmixing formulations.
+
+Requires an authenticated earth engine session. Graphs are only built and serialized,
+no computations are requested.
+
+Usage:
+  python benchmarks/bench_unmix_graph.py
+"""
+
+import time
+
+import ee
+import numpy as np
+
+from earthlib import SoilPVNPV
+from earthlib.Unmix import fractionalCover
+from earthlib.utils import endmemberArray, getBands, sampleEndmembers
+
+SENSOR = "Landsat8"
+ITERATIONS = [10, 30, 100]
+REPEATS = 5
+
+
+def endmemberLists(spectra: np.ndarray) -> tuple:
+    """Converts sampled endmembers to per-class lists with one ee.List per draw"""
+    n_iterations, n_classes, _ = np.shape(spectra)
+    array = endmemberArray(spectra)
+    return tuple(
+        [
+            array.slice(0, i, i + 1).slice(1, j, j + 1).project([2]).toList()
+            for i in range(n_iterations)
+        ]
+        for j in range(n_classes)
+    )
+
+
+def buildLists(img: ee.Image, spectra, bands: list) -> ee.Image:
+    """Builds the unmixing graph with one ee.List per endmember draw"""
+    return fractionalCover(
+        img,
+        endmemberLists(spectra),
+        SoilPVNPV.ENDMEMBER_NAMES,
+        n_bands=len(bands),
+    )
+
+
+def buildArray(img: ee.Image, spectra, bands: list) -> ee.Image:
+    """Builds the unmixing graph from a single ee.Array of endmembers"""
+    return fractionalCover(img, endmemberArray(spectra), SoilPVNPV.ENDMEMBER_NAMES)
+
+
+def measure(build, img: ee.Image, spectra, bands: list) -> tuple:
+    """Returns the best build time (ms) and serialized size (bytes) of a graph"""
+    timings = list()
+    for _ in range(REPEATS):
+        start = time.perf_counter()
+        graph = ee.serializer.toJSON(build(img, spectra, bands))
+        timings.append(time.perf_counter() - start)
+    return 1000 * min(timings), len(graph)
+
+
+def main():
+    ee.Initialize()
+    bands = getBands(SENSOR)
+    img = ee.Image.constant([0.1] * len(bands)).rename(bands)
+
+    print(f"{'iterations':>10} {'method':>8} {'build (ms)':>12} {'size (bytes)':>14}")
+    for n in ITERATIONS:
+        spectra = sampleEndmembers(["bare", "vegetation", "npv"], SENSOR, n, seed=0)
+        for method, build in [("lists", buildLists), ("array", buildArray)]:
+            build_ms, size = measure(build, img, spectra, bands)
+            print(f"{n:>10} {method:>8} {build_ms:>12.1f} {size:>14,}")
+
+
+if __name__ == "__main__":
+    main()
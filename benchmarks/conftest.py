@@ -0,0 +1,113 @@
+"""Shared fixtures for the earthlib benchmarks.
+
+Benchmarks run on synthetic tiles by default. Set EARTHLIB_BENCH_DATA to a directory of
+    GeoTIFFs named by sensor (e.g. Landsat8.tif), with band descriptions set to the band
+    names, to benchmark on real scenes instead. Tiles are cropped to TILE_SHAPE.
+"""
+
+import os
+
+import numpy as np
+import pytest
+
+from earthlib import Scale
+from earthlib.CloudMask import getRules
+from earthlib.errors import SensorError
+from earthlib.utils import getBands
+
+TILE_SHAPE = (512, 512)
+DATA_DIR = os.environ.get("EARTHLIB_BENCH_DATA")
+CLEAR_FRACTION = 0.7
+
+
+def syntheticTile(sensor: str, shape: tuple = TILE_SHAPE, seed: int = 0) -> dict:
+    """Simulates a tile of raw reflectance DNs and QA bands for a sensor.
+
+    Args:
+        sensor: the sensor name (e.g. "Landsat8") or a config.QA_RULES key.
+        shape: the (rows, cols) shape of the tile.
+        seed: the random seed.
+
+    Returns:
+        a dictionary of {band name: (rows, cols) array}.
+    """
+    rng = np.random.default_rng(seed)
+    tile = dict()
+    try:
+        bands = getBands(sensor)
+    except SensorError:
+        bands = []
+
+    if bands:
+        scale, offset = Scale.getScaleParams(sensor)
+        reflectance = rng.uniform(0.02, 0.6, size=(len(bands),) + tuple(shape))
+        dn = np.clip(np.rint((reflectance - offset) / scale), 0, 65535)
+        tile.update(zip(bands, dn.astype(np.uint16)))
+
+    # QA bands are clear for most pixels and have random flags set elsewhere
+    try:
+        rules = getRules(sensor)
+    except SensorError:
+        rules = []
+    for band in dict.fromkeys(rule[0] for rule in rules):
+        flags = rng.integers(0, 65536, size=shape, dtype=np.uint16)
+        tile[band] = np.where(rng.random(shape) < CLEAR_FRACTION, 0, flags)
+
+    return tile
+
+
+def sceneTile(sensor: str, shape: tuple = TILE_SHAPE) -> dict:
+    """Reads a tile from a real scene in EARTHLIB_BENCH_DATA, if there is one.
+
+    Args:
+        sensor: the sensor name (e.g. "Landsat8").
+        shape: the (rows, cols) shape to crop the scene to.
+
+    Returns:
+        a dictionary of {band name: (rows, cols) array}, or None without a scene.
+    """
+    if DATA_DIR is None:
+        return None
+
+    path = os.path.join(DATA_DIR, f"{sensor}.tif")
+    if not os.path.exists(path):
+        return None
+
+    import rasterio
+    from rasterio.windows import Window
+
+    with rasterio.open(path) as src:
+        rows, cols = min(shape[0], src.height), min(shape[1], src.width)
+        data = src.read(window=Window(0, 0, cols, rows))
+        return dict(zip(src.descriptions, data))
+
+
+@pytest.fixture(scope="session")
+def tiles():
+    """Returns a function that loads a (real or synthetic) tile by sensor name"""
+    loaded = dict()
+
+    def load(sensor: str) -> dict:
+        if sensor not in loaded:
+            loaded[sensor] = sceneTile(sensor) or syntheticTile(sensor)
+        return loaded[sensor]
+
+    return load
+
+
+@pytest.fixture
+def throughput(benchmark):
+    """Returns a function that benchmarks a call and records its throughput.
+
+    The rate is stored in the benchmark's extra info as "{unit}_per_second", based on
+        the mean run time.
+    """
+
+    def run(function, n_items: int, unit: str, *args, **kwargs):
+        result = benchmark(function, *args, **kwargs)
+        if benchmark.stats is not None:
+            rate = n_items / benchmark.stats.stats.mean
+            benchmark.extra_info[f"{unit}_per_second"] = rate
+        return result
+
+    return run
@@ -1,17 +1,34 @@
 """Routines to prepare datasets prior to unmixing"""
+import hashlib
 import math
 import re
+import threading
+from collections import OrderedDict
+from concurrent.futures import ThreadPoolExecutor
+from datetime import datetime, timezone
 from typing import Callable
 
 import ee
+import numpy as np
 
+from earthlib import profiling
 from earthlib.config import (
     BRDF_COEFFICIENTS_L8,
     BRDF_COEFFICIENTS_L457,
+    BRDF_CACHE_SIZE,
     BRDF_COEFFICIENTS_S2,
+    BRDF_GRID_STEP,
+    DEVICE,
+    N_THREADS,
+    TILE_ROWS,
 )
+from earthlib.buffers import arrayModule, asArray, toDevice
 from earthlib.errors import SensorError
 
+# coarse kernel grids by scene geometry, shared by every band and product from a scene
+_kernel_cache = OrderedDict()
+_kernel_lock = threading.Lock()
+
 
 def bySensor(sensor: str) -> Callable:
     """Get the appropriate BRDF correction function by sensor type.
@@ -31,7 +48,32 @@ def bySensor(sensor: str) -> Callable:
     }
     try:
         function = lookup[sensor]
-        return function
+        return profiling.instrument(function, f"BRDFCorrect.{sensor}")
+    except KeyError:
+        supported = ", ".join(lookup.keys())
+        raise SensorError(
+            f"BRDF adjustment not supported for '{sensor}'. Supported: {supported}"
+        )
+
+
+def getCoefficients(sensor: str) -> dict:
+    """Get the BRDF coefficients by band for a sensor type.
+
+    Args:
+        sensor: sensor name to return (e.g. "Landsat8", "Sentinel2").
+
+    Returns:
+        a dictionary of {band name: {"fiso", "fgeo", "fvol"}} coefficients.
+    """
+    lookup = {
+        "Landsat4": BRDF_COEFFICIENTS_L457,
+        "Landsat5": BRDF_COEFFICIENTS_L457,
+        "Landsat7": BRDF_COEFFICIENTS_L457,
+        "Landsat8": BRDF_COEFFICIENTS_L8,
+        "Sentinel2": BRDF_COEFFICIENTS_S2,
+    }
+    try:
+        return lookup[sensor]
     except KeyError:
         supported = ", ".join(lookup.keys())
         raise SensorError(
@@ -238,10 +280,8 @@ def sunZenOut(image: ee.Image) -> ee.Image:
             .bounds()
             .centroid(30)
             .coordinates()
-            .get(0)
-        )
-        .multiply(math.pi)
-        .divide(180),
+            .get(1)
+        ),
     )
     image = set(
         image,
@@ -396,10 +436,530 @@ def brdf(
             "kgeo": "i." + kgeoBand,
         },
     )
-    image = set(image, bandName, "{fiso} + {fvol} * {kvol} + {fgeo} * {kvol}", args)
+    image = set(image, bandName, "{fiso} + {fvol} * {kvol} + {fgeo} * {kgeo}", args)
     return image
 
 
+@profiling.timed()
+def brdfCorrectLocal(
+    bands: dict,
+    lon: np.ndarray,
+    lat: np.ndarray,
+    time_start: int,
+    corners: dict,
+    coefficientsByBand: dict,
+    scaleFactor: float = 1,
+    grid_step: int = BRDF_GRID_STEP,
+    block_rows: int = TILE_ROWS,
+    n_threads: int = N_THREADS,
+    device: str = DEVICE,
+) -> dict:
+    """Apply BRDF adjustments to a local scene or tile, mirroring brdfCorrectWrapper()
+
+    Sun/view angles and the Ross-Thick/Li-Thin kernels are computed on a coarse grid
+        every `grid_step` pixels, then bilinearly upsampled one row block at a time
+        and applied to every band while the block is in cache.
+
+    Args:
+        bands: a dictionary of {band name: (rows, cols) surface reflectance array}.
+        lon: pixel longitudes in degrees, broadcastable to (rows, cols).
+        lat: pixel latitudes in degrees, broadcastable to (rows, cols).
+        time_start: the acquisition time in milliseconds since the epoch (UTC).
+        corners: dictionary with "upperLeft", "upperRight", "lowerRight", "lowerLeft"
+            (lon, lat) scene corner coordinates. get from footprintCorners().
+        coefficientsByBand: the BRDF coefficients by band (e.g. from getCoefficients()).
+        scaleFactor: a scaling factor to tune the volumetric scattering adjustment.
+        grid_step: the spacing (in pixels) of the grid angles are computed on.
+        block_rows: the number of rows corrected at a time.
+        n_threads: the number of row blocks to correct concurrently.
+        device: the device to upsample and apply the kernels on ("cpu" or "gpu").
+
+    Returns:
+        a dictionary of BRDF-corrected bands with the input dtypes. bands without
+            coefficients are returned unchanged.
+    """
+    shape = next(iter(bands.values())).shape
+    kernels = kernelGrids(lon, lat, time_start, corners, shape, grid_step)
+    return applyKernels(
+        bands, kernels, coefficientsByBand, scaleFactor, block_rows, n_threads, device
+    )
+
+
+@profiling.timed()
+def kernelGrids(
+    lon: np.ndarray,
+    lat: np.ndarray,
+    time_start: int,
+    corners: dict,
+    shape: tuple,
+    grid_step: int = BRDF_GRID_STEP,
+) -> dict:
+    """Computes the BRDF kernels on a coarse grid over a scene.
+
+    The kernels only depend on geometry, so results are cached by scene footprint,
+        acquisition time, grid resolution and the sampled coordinates, and reused
+        for every band and every product derived from the same scene.
+
+    Args:
+        lon: pixel longitudes in degrees, broadcastable to `shape`.
+        lat: pixel latitudes in degrees, broadcastable to `shape`.
+        time_start: the acquisition time in milliseconds since the epoch (UTC).
+        corners: dictionary of (lon, lat) scene corner coordinates.
+        shape: the (rows, cols) shape of the scene.
+        grid_step: the spacing (in pixels) of the grid angles are computed on.
+
+    Returns:
+        a dictionary with coarse "kvol" and "kgeo" grids, the "rows" and "cols" pixel
+            indices they were sampled at, and the scalar nadir "kvol0" and "kgeo0".
+    """
+    rows = gridIndices(shape[0], grid_step)
+    cols = gridIndices(shape[1], grid_step)
+    lon = np.broadcast_to(lon, shape)[np.ix_(rows, cols)].astype(float)
+    lat = np.broadcast_to(lat, shape)[np.ix_(rows, cols)].astype(float)
+
+    digest = hashlib.sha1(lon.tobytes())
+    digest.update(lat.tobytes())
+    footprint = tuple(tuple(map(float, corners[name])) for name in sorted(corners))
+    key = (footprint, int(time_start), tuple(shape), grid_step, digest.hexdigest())
+    with _kernel_lock:
+        if key in _kernel_cache:
+            _kernel_cache.move_to_end(key)
+            profiling.count("BRDFCorrect.kernel_cache.hits")
+            return _kernel_cache[key]
+
+    profiling.count("BRDFCorrect.kernel_cache.misses")
+
+    sunZen, sunAz = solarPositionLocal(lon, lat, time_start)
+    viewZen, viewAz = viewAnglesLocal(lon, lat, corners)
+    relativeSunViewAz = sunAz - viewAz
+
+    sunZenOut = sunZenOutLocal(footprintCenterLat(corners))
+
+    kernels = {
+        "rows": rows,
+        "cols": cols,
+        "kvol": rossThickLocal(sunZen, viewZen, relativeSunViewAz),
+        "kgeo": liThinLocal(sunZen, viewZen, relativeSunViewAz),
+        "kvol0": float(rossThickLocal(sunZenOut, 0.0, 0.0)),
+        "kgeo0": float(liThinLocal(sunZenOut, 0.0, 0.0)),
+    }
+    for grid in ("rows", "cols", "kvol", "kgeo"):
+        kernels[grid].setflags(write=False)
+
+    with _kernel_lock:
+        _kernel_cache[key] = kernels
+        while len(_kernel_cache) > BRDF_CACHE_SIZE:
+            _kernel_cache.popitem(last=False)
+
+    return kernels
+
+
+def clearKernelCache() -> None:
+    """Removes all cached BRDF kernel grids."""
+    with _kernel_lock:
+        _kernel_cache.clear()
+
+
+def applyKernels(
+    bands: dict,
+    kernels: dict,
+    coefficientsByBand: dict,
+    scaleFactor: float = 1,
+    block_rows: int = TILE_ROWS,
+    n_threads: int = N_THREADS,
+    device: str = DEVICE,
+) -> dict:
+    """Applies BRDF c-factor adjustments to every band in one pass over row blocks.
+
+    Args:
+        bands: a dictionary of {band name: (rows, cols) surface reflectance array}.
+        kernels: the coarse kernel grids from kernelGrids().
+        coefficientsByBand: the BRDF coefficients by band.
+        scaleFactor: a scaling factor to tune the volumetric scattering adjustment.
+        block_rows: the number of rows corrected at a time.
+        n_threads: the number of row blocks to correct concurrently.
+        device: the device to upsample and apply the kernels on ("cpu" or "gpu").
+
+    Returns:
+        a dictionary of BRDF-corrected bands with the input dtypes.
+    """
+    shape = next(iter(bands.values())).shape
+    corrected = {name: band for name, band in bands.items()}
+    for name in coefficientsByBand:
+        if name in bands:
+            corrected[name] = np.empty(shape, dtype=bands[name].dtype)
+
+    def correctBlock(start):
+        stop = min(start + block_rows, shape[0])
+        block = {name: band[start:stop] for name, band in bands.items()}
+        adjusted = correctRows(
+            block, kernels, coefficientsByBand, scaleFactor, start, device
+        )
+        for name, values in adjusted.items():
+            corrected[name][start:stop] = values
+
+    with ThreadPoolExecutor(max_workers=max(1, n_threads)) as executor:
+        list(executor.map(correctBlock, range(0, shape[0], block_rows)))
+
+    return corrected
+
+
+@profiling.timed()
+def correctRows(
+    bands: dict,
+    kernels: dict,
+    coefficientsByBand: dict,
+    scaleFactor: float = 1,
+    row_offset: int = 0,
+    device: str = DEVICE,
+) -> dict:
+    """Applies BRDF c-factor adjustments to a block of rows from a scene.
+
+    Args:
+        bands: a dictionary of {band name: (block rows, cols) surface reflectance array}.
+        kernels: the coarse kernel grids for the full scene from kernelGrids().
+        coefficientsByBand: the BRDF coefficients by band.
+        scaleFactor: a scaling factor to tune the volumetric scattering adjustment.
+        row_offset: the scene row index of the first row in the block.
+        device: the device to upsample and apply the kernels on ("cpu" or "gpu").
+            outputs are always returned in host memory.
+
+    Returns:
+        a dictionary of float32 BRDF-corrected bands, for bands with coefficients.
+    """
+    names = [name for name in coefficientsByBand if name in bands]
+    if len(names) == 0:
+        return dict()
+
+    n_rows, n_cols = bands[names[0]].shape
+    profiling.count("BRDFCorrect.pixels", n_rows * n_cols * len(names))
+    rows = np.arange(row_offset, row_offset + n_rows)
+    cols = np.arange(n_cols)
+    gridRows, gridCols = kernels["rows"], kernels["cols"]
+    kvol = toDevice(kernels["kvol"], device)
+    kgeo = toDevice(kernels["kgeo"], device)
+    kvol = bilinearUpsample(kvol, gridRows, gridCols, rows, cols)
+    kgeo = bilinearUpsample(kgeo, gridRows, gridCols, rows, cols)
+    xp = arrayModule(kvol)
+
+    corrected = dict()
+    for name in names:
+        c = coefficientsByBand[name]
+
+        # the nadir brdf only depends on the scene center, so it is one value per band
+        brdf0 = (
+            c["fiso"]
+            + c["fvol"] * scaleFactor * kernels["kvol0"]
+            + c["fgeo"] * kernels["kgeo0"]
+        )
+        cFactor = xp.multiply(kvol, c["fvol"] * scaleFactor)
+        cFactor += c["fgeo"] * kgeo
+        cFactor += c["fiso"]
+        xp.divide(brdf0, cFactor, out=cFactor)
+        cFactor *= toDevice(bands[name], device)
+        corrected[name] = asArray(cFactor)
+
+    return corrected
+
+
+def solarPositionLocal(lon: np.ndarray, lat: np.ndarray, time_start: int) -> tuple:
+    """Compute solar zenith and azimuth angles, mirroring solarPosition()
+
+    Args:
+        lon: longitudes in degrees.
+        lat: latitudes in degrees.
+        time_start: the acquisition time in milliseconds since the epoch (UTC).
+
+    Returns:
+        (sunZen, sunAz): the solar zenith and azimuth angles in radians.
+    """
+    date = datetime.fromtimestamp(time_start / 1000, tz=timezone.utc)
+    yearStart = datetime(date.year, 1, 1, tzinfo=timezone.utc)
+    yearEnd = datetime(date.year + 1, 1, 1, tzinfo=timezone.utc)
+    dayStart = date.replace(hour=0, minute=0, second=0, microsecond=0)
+
+    latRad = np.radians(lat)
+    hourGMT = (date - dayStart).total_seconds() / 3600
+    jdpr = (date - yearStart) / (yearEnd - yearStart) * 2 * math.pi
+    meanSolarTime = hourGMT + lon / 15
+    localSolarDiff = (
+        (
+            0.000075
+            + 0.001868 * math.cos(jdpr)
+            - 0.032077 * math.sin(jdpr)
+            - 0.014615 * math.cos(2 * jdpr)
+            - 0.040849 * math.sin(2 * jdpr)
+        )
+        * 12
+        * 60
+        / math.pi
+    )
+    trueSolarTime = meanSolarTime + localSolarDiff / 60 - 12
+    angleHour = np.radians(trueSolarTime * 15)
+    delta = (
+        0.006918
+        - 0.399912 * math.cos(jdpr)
+        + 0.070257 * math.sin(jdpr)
+        - 0.006758 * math.cos(2 * jdpr)
+        + 0.000907 * math.sin(2 * jdpr)
+        - 0.002697 * math.cos(3 * jdpr)
+        + 0.001480 * math.sin(3 * jdpr)
+    )
+
+    cosSunZen = np.sin(latRad) * math.sin(delta) + np.cos(latRad) * math.cos(
+        delta
+    ) * np.cos(angleHour)
+    sunZen = np.arccos(np.clip(cosSunZen, -1, 1))
+    sinSunZen = np.sin(sunZen)
+    sinSunAzSW = np.clip(math.cos(delta) * np.sin(angleHour) / sinSunZen, -1, 1)
+    cosSunAzSW = (
+        -np.cos(latRad) * math.sin(delta)
+        + np.sin(latRad) * math.cos(delta) * np.cos(angleHour)
+    ) / sinSunZen
+
+    sunAzSW = np.arcsin(sinSunAzSW)
+    sunAzSW = np.where(cosSunAzSW <= 0, math.pi - sunAzSW, sunAzSW)
+    sunAzSW = np.where(
+        (cosSunAzSW > 0) & (sinSunAzSW <= 0), 2 * math.pi + sunAzSW, sunAzSW
+    )
+    sunAz = sunAzSW + math.pi
+    sunAz = np.where(sunAz > 2 * math.pi, sunAz - 2 * math.pi, sunAz)
+
+    return sunZen, sunAz
+
+
+def viewAnglesLocal(lon: np.ndarray, lat: np.ndarray, corners: dict) -> tuple:
+    """Compute sensor view angles, mirroring viewAngles()
+
+    Args:
+        lon: longitudes in degrees.
+        lat: latitudes in degrees.
+        corners: dictionary of (lon, lat) scene corner coordinates.
+
+    Returns:
+        (viewZen, viewAz): the view zenith (per pixel) and azimuth angles in radians.
+    """
+    maxSatelliteZenith = 7.5
+    upperCenter = np.mean([corners["upperLeft"], corners["upperRight"]], axis=0)
+    lowerCenter = np.mean([corners["lowerLeft"], corners["lowerRight"]], axis=0)
+    with np.errstate(divide="ignore"):
+        slope = np.float64(lowerCenter[1] - upperCenter[1]) / (
+            lowerCenter[0] - upperCenter[0]
+        )
+        slopePerp = -1 / slope
+    viewAz = math.pi / 2 - math.atan(slopePerp)
+
+    # distances to the scene edges, on a locally-equidistant grid
+    xScale = math.cos(math.radians(np.mean([corner[1] for corner in corners.values()])))
+    leftDistance = segmentDistance(
+        lon, lat, corners["upperLeft"], corners["lowerLeft"], xScale
+    )
+    rightDistance = segmentDistance(
+        lon, lat, corners["upperRight"], corners["lowerRight"], xScale
+    )
+    viewZenith = (
+        rightDistance * maxSatelliteZenith * 2 / (rightDistance + leftDistance)
+        - maxSatelliteZenith
+    )
+
+    return np.radians(viewZenith), viewAz
+
+
+def sunZenOutLocal(centerLat: float) -> float:
+    """Compute the solar zenith angle at the scene center, mirroring sunZenOut()
+
+    Args:
+        centerLat: the scene center latitude in degrees.
+
+    Returns:
+        the normalized solar zenith angle in radians.
+    """
+    sunZenOut = (
+        31.0076
+        - 0.1272 * centerLat
+        + 0.01187 * centerLat**2
+        + 2.40e-05 * centerLat**3
+        - 9.48e-07 * centerLat**4
+        - 1.95e-09 * centerLat**5
+        + 6.15e-11 * centerLat**6
+    )
+    return math.radians(sunZenOut)
+
+
+def rossThickLocal(
+    sunZen: np.ndarray, viewZen: np.ndarray, relativeSunViewAz: np.ndarray
+) -> np.ndarray:
+    """Ross-Thick volumetric scattering kernel, mirroring rossThick()"""
+    cosPhaseAngle = cosPhaseAngleLocal(sunZen, viewZen, relativeSunViewAz)
+    phaseAngle = np.arccos(cosPhaseAngle)
+    return ((math.pi / 2 - phaseAngle) * cosPhaseAngle + np.sin(phaseAngle)) / (
+        np.cos(sunZen) + np.cos(viewZen)
+    ) - math.pi / 4
+
+
+def liThinLocal(
+    sunZen: np.ndarray, viewZen: np.ndarray, relativeSunViewAz: np.ndarray
+) -> np.ndarray:
+    """Li-Thin geometric scattering kernel, mirroring liThin()"""
+    hb = 2
+    sunZenPrime = anglePrimeLocal(sunZen)
+    viewZenPrime = anglePrimeLocal(viewZen)
+    cosPhaseAnglePrime = cosPhaseAngleLocal(
+        sunZenPrime, viewZenPrime, relativeSunViewAz
+    )
+    tanSun = np.tan(sunZenPrime)
+    tanView = np.tan(viewZenPrime)
+    distance = np.sqrt(
+        np.maximum(
+            tanSun**2 + tanView**2 - 2 * tanSun * tanView * np.cos(relativeSunViewAz),
+            0,
+        )
+    )
+    temp = 1 / np.cos(sunZenPrime) + 1 / np.cos(viewZenPrime)
+    cosT = np.clip(
+        hb
+        * np.sqrt(distance**2 + (tanSun * tanView * np.sin(relativeSunViewAz)) ** 2)
+        / temp,
+        -1,
+        1,
+    )
+    t = np.arccos(cosT)
+    overlap = (1 / math.pi) * (t - np.sin(t) * cosT) * temp
+    overlap = np.where(overlap > 0, 0, overlap)
+    return (
+        overlap
+        - temp
+        + 0.5
+        * (1 + cosPhaseAnglePrime)
+        * (1 / np.cos(sunZenPrime))
+        * (1 / np.cos(viewZenPrime))
+    )
+
+
+def anglePrimeLocal(angle: np.ndarray) -> np.ndarray:
+    """Prime angle from sun/sensor zenith, mirroring anglePrime()"""
+    br = 1
+    return np.arctan(np.maximum(br * np.tan(angle), 0))
+
+
+def cosPhaseAngleLocal(
+    sunZen: np.ndarray, viewZen: np.ndarray, relativeSunViewAz: np.ndarray
+) -> np.ndarray:
+    """Cosine of the phase angle, mirroring cosPhaseAngle()"""
+    return np.clip(
+        np.cos(sunZen) * np.cos(viewZen)
+        + np.sin(sunZen) * np.sin(viewZen) * np.cos(relativeSunViewAz),
+        -1,
+        1,
+    )
+
+
+def footprintCorners(coords: np.ndarray) -> dict:
+    """Get corner coordinates from footprint coordinates, mirroring findCorners()
+
+    Args:
+        coords: an (n_points, 2) array of (lon, lat) footprint vertices.
+
+    Returns:
+        a dictionary of (lon, lat) tuples for each corner, keyed like findCorners().
+    """
+    coords = np.asarray(coords, dtype=float)
+    xs, ys = coords[:, 0], coords[:, 1]
+
+    def findCorner(targetValue, values):
+        return tuple(coords[np.argmin(np.abs(values - targetValue))])
+
+    return {
+        "upperLeft": findCorner(ys.max(), ys),
+        "upperRight": findCorner(xs.max(), xs),
+        "lowerRight": findCorner(ys.min(), ys),
+        "lowerLeft": findCorner(xs.min(), xs),
+    }
+
+
+def footprintCenterLat(corners: dict) -> float:
+    """Get the footprint center latitude, mirroring the bounds centroid in sunZenOut()
+
+    The corners include the northern- and southernmost footprint vertices, so the
+        center of their latitude range is the centroid latitude of the footprint's
+        bounding rectangle.
+
+    Args:
+        corners: a dictionary of (lon, lat) corners (from footprintCorners()).
+
+    Returns:
+        the center latitude in degrees.
+    """
+    lats = [corner[1] for corner in corners.values()]
+    return (min(lats) + max(lats)) / 2
+
+
+def segmentDistance(
+    lon: np.ndarray, lat: np.ndarray, pointA: tuple, pointB: tuple, xScale: float = 1
+) -> np.ndarray:
+    """Compute the planar distance from each location to a line segment"""
+    ax, ay = pointA[0] * xScale, pointA[1]
+    bx, by = pointB[0] * xScale, pointB[1]
+    px, py = lon * xScale - ax, lat - ay
+    dx, dy = bx - ax, by - ay
+    length = dx**2 + dy**2
+    t = np.clip((px * dx + py * dy) / length, 0, 1) if length > 0 else 0
+    return np.hypot(px - t * dx, py - t * dy)
+
+
+def gridIndices(size: int, step: int) -> np.ndarray:
+    """Get the pixel indices of a coarse grid, always including the last pixel"""
+    indices = np.arange(0, size, max(1, step))
+    if indices[-1] != size - 1:
+        indices = np.append(indices, size - 1)
+    return indices
+
+
+def bilinearUpsample(
+    grid: np.ndarray,
+    gridRows: np.ndarray,
+    gridCols: np.ndarray,
+    rows: np.ndarray,
+    cols: np.ndarray,
+) -> np.ndarray:
+    """Bilinearly interpolate a coarse grid to a block of pixel locations
+
+    Args:
+        grid: the (n_grid_rows, n_grid_cols) coarse values. the interpolation runs on
+            the device the grid is on (a numpy or cupy array).
+        gridRows: the pixel row of each coarse grid row.
+        gridCols: the pixel column of each coarse grid column.
+        rows: the pixel rows to interpolate to.
+        cols: the pixel columns to interpolate to.
+
+    Returns:
+        a float32 array of shape (len(rows), len(cols)).
+    """
+    xp = arrayModule(grid)
+    r0, wr = gridWeights(gridRows, rows)
+    c0, wc = gridWeights(gridCols, cols)
+    r1 = np.minimum(r0 + 1, len(gridRows) - 1)
+    c1 = np.minimum(c0 + 1, len(gridCols) - 1)
+    r0, r1, c0, c1 = (xp.asarray(index) for index in (r0, r1, c0, c1))
+
+    grid = grid.astype(np.float32, copy=False)
+    wr = xp.asarray(wr, dtype=np.float32)[:, np.newaxis]
+    wc = xp.asarray(wc, dtype=np.float32)
+    top = grid[r0][:, c0] * (1 - wc) + grid[r0][:, c1] * wc
+    bottom = grid[r1][:, c0] * (1 - wc) + grid[r1][:, c1] * wc
+    return top * (1 - wr) + bottom * wr
+
+
+def gridWeights(coarse: np.ndarray, target: np.ndarray) -> tuple:
+    """Get the lower coarse index and linear weight for each target location"""
+    if len(coarse) == 1:
+        return np.zeros(len(target), dtype=int), np.zeros(len(target))
+    lower = np.searchsorted(coarse, target, side="right") - 1
+    lower = np.clip(lower, 0, len(coarse) - 2)
+    weight = (target - coarse[lower]) / (coarse[lower + 1] - coarse[lower])
+    return lower, weight
+
+
 def x(point: ee.Geometry.Point):
     """Get the X location from a point geometry"""
     return ee.Number(ee.List(point).get(0))
@@ -478,13 +1038,22 @@ def set(
 
 
 def setIf(
-    image: ee.Image, name: str, condition: str, TrueValue: float, FalseValue: float = 0
+    image: ee.Image,
+    name: str,
+    condition: str,
+    TrueValue: float,
+    FalseValue: float = None,
 ) -> ee.Image:
-    """Create a conditional mask and add it as a band to `image`"""
+    """Create a conditional mask and add it as a band to `image`
+
+    `name` keeps its current value where `condition` is False unless `FalseValue` is set.
+    """
 
     def invertMask(mask):
         return mask.multiply(-1).add(1)
 
+    if FalseValue is None:
+        FalseValue = name
     condition = toImage(image, condition)
     TrueMasked = toImage(image, TrueValue).mask(toImage(image, condition))
     FalseMasked = toImage(image, FalseValue).mask(invertMask(condition))
@@ -1,11 +1,32 @@
 """Functions for cloud masking earth engine images."""
 
+import math
+import threading
+from concurrent.futures import ThreadPoolExecutor
 from typing import Callable
 
 import ee
+import numpy as np
 
+from earthlib import profiling
+from earthlib.buffers import asArrays, outputArray
+from earthlib.config import N_THREADS, QA_RULES, TILE_ROWS
 from earthlib.errors import SensorError
 
+# comparison operators supported in QA rule tables
+COMPARISONS = {
+    "eq": np.equal,
+    "neq": np.not_equal,
+    "lt": np.less,
+    "lte": np.less_equal,
+    "gt": np.greater,
+    "gte": np.greater_equal,
+}
+
+# QA rule tables compiled to bitmasks/lookup tables, shared across calls
+_compiled_rules = dict()
+_compiled_lock = threading.Lock()
+
 
 def bitwiseSelect(img: ee.Image, fromBit: int, toBit: int = None) -> ee.Image:
     """Filter QA bit masks.
@@ -24,6 +45,25 @@ def bitwiseSelect(img: ee.Image, fromBit: int, toBit: int = None) -> ee.Image:
     return img.rightShift(fromBit).bitwiseAnd(mask)
 
 
+def ruleMask(img: ee.Image, rules: list) -> ee.Image:
+    """Builds a validity mask from a QA rule table.
+
+    Args:
+        img: the image with the QA bands referenced in `rules`.
+        rules: list of (band, fromBit, toBit, comparison, value) rules (e.g. from config.QA_RULES).
+
+    Returns:
+        a mask that is 1 where every rule is True.
+    """
+    mask = None
+    for band, fromBit, toBit, comparison, value in rules:
+        field = bitwiseSelect(img.select(band), fromBit, toBit)
+        test = getattr(field, comparison)(value)
+        mask = test if mask is None else mask.And(test)
+
+    return mask
+
+
 def bySensor(sensor: str) -> Callable:
     """Returns the appropriate cloud mask function to use by sensor type.
 
@@ -44,7 +84,7 @@ def bySensor(sensor: str) -> Callable:
     }
     try:
         function = lookup[sensor]
-        return function
+        return profiling.instrument(function, f"CloudMask.{sensor}")
     except KeyError:
         supported = ", ".join(lookup.keys())
         raise SensorError(
@@ -64,18 +104,7 @@ def Landsat4578(img: ee.Image) -> ee.Image:
     Returns:
         the same input image with an updated mask.
     """
-    qa = img.select("QA_PIXEL")
-    sat = img.select("QA_RADSAT")
-
-    dilatedCloud = bitwiseSelect(qa, 1).eq(0)
-    cirrus = bitwiseSelect(qa, 2).eq(0)
-    cloud = bitwiseSelect(qa, 3).eq(0)
-    cloudShadow = bitwiseSelect(qa, 4).eq(0)
-    snow = bitwiseSelect(qa, 5).eq(0)
-    qaMask = dilatedCloud.And(cirrus).And(cloud).And(cloudShadow).And(snow)
-
-    satMask = sat.eq(0)
-    jointMask = qaMask.And(satMask)
+    jointMask = ruleMask(img, QA_RULES["Landsat4578"])
 
     return img.updateMask(jointMask)
 
@@ -109,10 +138,7 @@ def Sentinel2QA(img: ee.Image) -> ee.Image:
     Returns:
         the same input image with an updated mask.
     """
-    qa = img.select("QA60")
-    cloud = bitwiseSelect(qa, 10).eq(0)
-    cirrus = bitwiseSelect(qa, 11).eq(0)
-    mask = cloud.And(cirrus)
+    mask = ruleMask(img, QA_RULES["Sentinel2QA"])
 
     return img.updateMask(mask)
 
@@ -129,14 +155,8 @@ def Sentinel2SCL(img: ee.Image) -> ee.Image:
     scl = img.select("SCL")
 
     # class labels
-    sat = scl.neq(1)
-    shadow = scl.neq(3)
-    cloudLow = scl.neq(7)
-    cloudMed = scl.neq(8)
-    cloudHigh = scl.neq(9)
-    cirrus = scl.neq(10)
     bareSoil = scl.eq(5)
-    baseMask = sat.And(shadow).And(cloudLow).And(cloudMed).And(cloudHigh).And(cirrus)
+    baseMask = ruleMask(img, QA_RULES["Sentinel2SCL"])
 
     # apply morphological closing to clean up one/two pixel cloud predictions
     cleanupKernel = ee.Kernel.circle(2)
@@ -161,24 +181,8 @@ def MODIS(img: ee.Image) -> ee.Image:
     Returns:
         the same input image with an updated mask.
     """
-    qa = img.select("state_1km")
-
-    clearMask = bitwiseSelect(qa, 0, 1).eq(0)
-    shadowMask = bitwiseSelect(qa, 2).eq(0)
-    aerosolMask = bitwiseSelect(qa, 6, 7).lte(1)
-    cirrusMask = bitwiseSelect(qa, 8, 9).eq(0)
-    cloudMask = bitwiseSelect(qa, 10).eq(0)
-    fireMask = bitwiseSelect(qa, 11).eq(0)
-    snowMask = bitwiseSelect(qa, 15).eq(0)
-
-    mask = (
-        clearMask.And(shadowMask)
-        .And(aerosolMask)
-        .And(cirrusMask)
-        .And(cloudMask)
-        .And(fireMask)
-        .And(snowMask)
-    )
+    mask = ruleMask(img, QA_RULES["MODIS"])
+
     return img.updateMask(mask)
 
 
@@ -191,28 +195,7 @@ def VIIRS(img: ee.Image) -> ee.Image:
     Returns:
         the same input image with an updated mask.
     """
-    qf1 = img.select("QF1")
-    qf2 = img.select("QF2")
-    qf7 = img.select("QF7")
-
-    clearMask = bitwiseSelect(qf1, 2, 3).eq(0)
-    dayMask = bitwiseSelect(qf1, 4).eq(0)
-    shadowMask = bitwiseSelect(qf2, 3).eq(0)
-    snowMask = bitwiseSelect(qf2, 5).eq(0)
-    cirrus1Mask = bitwiseSelect(qf2, 6).eq(0)
-    cirrus2Mask = bitwiseSelect(qf2, 7).eq(0)
-    adjacentMask = bitwiseSelect(qf7, 1).eq(0)
-    thinCirrusMask = bitwiseSelect(qf7, 4).eq(0)
-
-    mask = (
-        clearMask.And(dayMask)
-        .And(shadowMask)
-        .And(snowMask)
-        .And(cirrus1Mask)
-        .And(cirrus2Mask)
-        .And(adjacentMask)
-        .And(thinCirrusMask)
-    )
+    mask = ruleMask(img, QA_RULES["VIIRS"])
 
     return img.updateMask(mask)
 
@@ -234,3 +217,311 @@ def Opening(img: ee.Image, iterations: int = 3) -> ee.Image:
     openedMask = mask.focalMin(**dilateOpts).focalMax(**erodeOpts)
 
     return img.updateMask(openedMask)
+
+
+def getRules(sensor: str) -> list:
+    """Returns the QA rule table to use by sensor type.
+
+    Args:
+        sensor: the sensor name (e.g. "Landsat8", "Sentinel2") or a config.QA_RULES key.
+
+    Returns:
+        list of (band, fromBit, toBit, comparison, value) rules.
+    """
+    landsat = ["Landsat4", "Landsat5", "Landsat7", "Landsat8"]
+    key = "Landsat4578" if sensor in landsat else sensor
+    try:
+        return QA_RULES[key]
+    except KeyError:
+        supported = ", ".join(landsat + list(QA_RULES.keys()))
+        raise SensorError(
+            f"Cloud masking not supported for '{sensor}'. Supported: {supported}"
+        )
+
+
+def compileRules(rules: list) -> list:
+    """Compiles a QA rule table into one decoding operation per QA band.
+
+    Bands where every rule tests a bit field against zero reduce to a single combined
+        bitmask test. Other bands get a boolean lookup table indexed by the QA value.
+
+    Args:
+        rules: list of (band, fromBit, toBit, comparison, value) rules.
+
+    Returns:
+        list of (band, kind, table) tuples, where kind is "bits" (table is an int
+            bitmask) or "lut" (table is a boolean array).
+    """
+    key = tuple(tuple(rule) for rule in rules)
+    with _compiled_lock:
+        if key in _compiled_rules:
+            return _compiled_rules[key]
+
+    byBand = dict()
+    for band, fromBit, toBit, comparison, value in rules:
+        if comparison not in COMPARISONS:
+            raise ValueError(
+                f"Unsupported comparison: {comparison}. Supported: {list(COMPARISONS)}"
+            )
+        byBand.setdefault(band, []).append((fromBit, toBit, comparison, value))
+
+    compiled = list()
+    for band, bandRules in byBand.items():
+        zeroTests = [op == "eq" and value == 0 for *_, op, value in bandRules]
+        if all(zeroTests):
+            bits = 0
+            for fromBit, toBit, _, _ in bandRules:
+                bits |= ((1 << (toBit - fromBit + 1)) - 1) << fromBit
+            compiled.append((band, "bits", bits))
+        else:
+            n_bits = max(toBit for _, toBit, _, _ in bandRules) + 1
+            values = np.arange(1 << n_bits)
+            lut = np.ones(len(values), dtype=bool)
+            for fromBit, toBit, comparison, value in bandRules:
+                field = (values >> fromBit) & ((1 << (toBit - fromBit + 1)) - 1)
+                lut &= COMPARISONS[comparison](field, value)
+            compiled.append((band, "lut", lut))
+
+    with _compiled_lock:
+        _compiled_rules[key] = compiled
+
+    return compiled
+
+
+@profiling.timed()
+def qaMaskLocal(
+    bands: dict,
+    sensor: str,
+    pack: bool = True,
+    block_rows: int = TILE_ROWS,
+    n_threads: int = N_THREADS,
+    out: np.ndarray = None,
+) -> np.ndarray:
+    """Computes a cloud mask from QA bands on local arrays in one pass.
+
+    All QA bands are decoded one row block at a time with their compiled rules and
+        combined before moving to the next block. Scene classification cleanup
+        (morphological closing, bare soil filtering) is only applied on earth engine.
+
+    Args:
+        bands: a dictionary of {band name: (rows, cols) integer QA array}.
+            any array-like buffer is accepted (see buffers.asArrays()).
+        sensor: the sensor name (e.g. "Landsat8", "Sentinel2") or a config.QA_RULES key.
+        pack: return a 1-bit-per-pixel bitmap instead of a boolean array.
+        block_rows: the number of rows decoded at a time.
+        n_threads: the number of row blocks to decode concurrently.
+        out: an optional array to write the mask to, with the shape and type returned.
+
+    Returns:
+        the validity mask (True/1 for clear pixels). packed masks have shape
+            (rows, ceil(cols / 8)), with bits in big-endian order (see unpackMask()).
+    """
+    compiled = compileRules(getRules(sensor))
+    bands = asArrays(bands)
+    shape = bands[compiled[0][0]].shape
+    if pack:
+        mask = outputArray(out, (shape[0], (shape[1] + 7) // 8), np.uint8)
+    else:
+        mask = outputArray(out, shape, bool)
+
+    def maskBlock(start):
+        stop = min(start + block_rows, shape[0])
+        valid = np.ones((stop - start, shape[1]), dtype=bool)
+        for band, kind, table in compiled:
+            qa = bands[band][start:stop]
+            if kind == "bits":
+                valid &= (qa & table) == 0
+            else:
+                valid &= table[qa & (len(table) - 1)]
+        mask[start:stop] = np.packbits(valid, axis=-1) if pack else valid
+        if profiling.isEnabled():
+            profiling.count("CloudMask.pixels", valid.size)
+            profiling.count("CloudMask.masked", valid.size - np.count_nonzero(valid))
+
+    with ThreadPoolExecutor(max_workers=max(1, n_threads)) as executor:
+        list(executor.map(maskBlock, range(0, shape[0], block_rows)))
+
+    return mask
+
+
+def unpackMask(packed: np.ndarray, n_cols: int) -> np.ndarray:
+    """Converts a 1-bit packed mask to a boolean array.
+
+    Args:
+        packed: a packed mask from qaMaskLocal().
+        n_cols: the number of columns in the unpacked mask.
+
+    Returns:
+        a boolean array of shape (rows, n_cols).
+    """
+    return np.unpackbits(packed, axis=-1, count=n_cols).astype(bool)
+
+
+def openingLocal(
+    mask: np.ndarray,
+    iterations: int = 3,
+    radius: int = None,
+    kernel: str = "circle",
+    n_cols: int = None,
+) -> np.ndarray:
+    """Apply a morphological opening filter to a local mask, mirroring Opening().
+
+    The cost is independent of radius: square kernels use separable van Herk/Gil-Werman
+        running min/max filters, and circle kernels threshold a distance transform.
+
+    Args:
+        mask: a 2d boolean mask, or a packed mask from qaMaskLocal() if `n_cols` is set.
+        iterations: the number of sequential erode/dilate operations with a circle
+            kernel of this radius, as in Opening(). ignored if `radius` is set.
+        radius: the total erosion/dilation radius in pixels.
+        kernel: the kernel shape. supported values are "circle" and "square".
+        n_cols: the number of columns in the unpacked mask, for packed inputs.
+
+    Returns:
+        the opened mask, packed if the input was packed.
+    """
+    if radius is None:
+        radius = iterations * iterations
+
+    packed = n_cols is not None
+    if packed:
+        mask = unpackMask(mask, n_cols)
+
+    opened = dilateLocal(erodeLocal(mask, radius, kernel), radius, kernel)
+
+    return np.packbits(opened, axis=-1) if packed else opened
+
+
+def erodeLocal(mask: np.ndarray, radius: int, kernel: str = "circle") -> np.ndarray:
+    """Erodes a boolean mask (a focal minimum) with a radius-independent cost.
+
+    Args:
+        mask: a 2d boolean mask.
+        radius: the kernel radius in pixels.
+        kernel: the kernel shape. supported values are "circle" and "square".
+
+    Returns:
+        the eroded mask. pixels outside the mask extent are treated as True.
+    """
+    mask = np.asarray(mask, dtype=bool)
+    if kernel == "square":
+        return squareFilter(mask, radius, np.minimum, True)
+    elif kernel == "circle":
+        return chamferDistance(~mask) > radius
+    else:
+        raise ValueError(f"Unsupported kernel: {kernel}. Supported: circle, square")
+
+
+def dilateLocal(mask: np.ndarray, radius: int, kernel: str = "circle") -> np.ndarray:
+    """Dilates a boolean mask (a focal maximum) with a radius-independent cost.
+
+    Args:
+        mask: a 2d boolean mask.
+        radius: the kernel radius in pixels.
+        kernel: the kernel shape. supported values are "circle" and "square".
+
+    Returns:
+        the dilated mask. pixels outside the mask extent are treated as False.
+    """
+    mask = np.asarray(mask, dtype=bool)
+    if kernel == "square":
+        return squareFilter(mask, radius, np.maximum, False)
+    elif kernel == "circle":
+        return chamferDistance(mask) <= radius
+    else:
+        raise ValueError(f"Unsupported kernel: {kernel}. Supported: circle, square")
+
+
+def squareFilter(
+    mask: np.ndarray, radius: int, reducer: np.ufunc, fill: bool
+) -> np.ndarray:
+    """Applies a (2 * radius + 1) square min/max filter as two separable passes.
+
+    Args:
+        mask: a 2d boolean mask.
+        radius: the kernel radius in pixels.
+        reducer: np.minimum (erosion) or np.maximum (dilation).
+        fill: the value assumed beyond the mask edges.
+
+    Returns:
+        the filtered mask.
+    """
+    rows = runningExtreme(mask, radius, reducer, fill)
+    return runningExtreme(rows.T, radius, reducer, fill).T
+
+
+def runningExtreme(
+    array: np.ndarray, radius: int, reducer: np.ufunc, fill: bool
+) -> np.ndarray:
+    """Computes a centered running min/max along the last axis with van Herk/Gil-Werman.
+
+    The padded array is split into blocks the size of the window. Any window spans at
+        most two blocks, so it reduces to one forward and one backward cumulative
+        min/max per block, for three comparisons per pixel at any radius.
+
+    Args:
+        array: the input array.
+        radius: the half-width of the window.
+        reducer: np.minimum or np.maximum.
+        fill: the value assumed beyond the array edges.
+
+    Returns:
+        an array the same shape as `array`.
+    """
+    if radius <= 0:
+        return array.copy()
+
+    width = 2 * radius + 1
+    n = array.shape[-1]
+    n_blocks = -(-(n + 2 * radius) // width)
+    padded = np.full(array.shape[:-1] + (n_blocks * width,), fill, dtype=array.dtype)
+    padded[..., radius : radius + n] = array
+
+    blocks = padded.reshape(array.shape[:-1] + (n_blocks, width))
+    forward = reducer.accumulate(blocks, axis=-1).reshape(padded.shape)
+    backward = reducer.accumulate(blocks[..., ::-1], axis=-1)[..., ::-1]
+    backward = backward.reshape(padded.shape)
+
+    return reducer(backward[..., :n], forward[..., width - 1 : width - 1 + n])
+
+
+def chamferDistance(features: np.ndarray) -> np.ndarray:
+    """Computes the approximate euclidean distance to the nearest feature pixel.
+
+    Uses a two-pass 3x3 chamfer transform (steps of 1 and sqrt(2)). Propagation along
+        a row is a running minimum of (distance - step * index), so each pass is one
+        vectorized update per row.
+
+    Args:
+        features: a 2d boolean array, True for feature pixels.
+
+    Returns:
+        float32 distances in pixels. inf everywhere if there are no features.
+    """
+    a, b = 1.0, math.sqrt(2)
+    distance = np.where(features, 0, np.inf).astype(np.float32)
+    n_rows, n_cols = distance.shape
+    ramp = np.arange(n_cols, dtype=np.float32) * a
+    neighbors = np.empty(n_cols, dtype=np.float32)
+
+    def propagate(row, previous):
+        if previous is not None:
+            np.minimum(row, previous + a, out=row)
+            neighbors[1:] = previous[:-1] + b
+            neighbors[0] = np.inf
+            np.minimum(row, neighbors, out=row)
+            neighbors[:-1] = previous[1:] + b
+            neighbors[-1] = np.inf
+            np.minimum(row, neighbors, out=row)
+
+    for i in range(n_rows):
+        row = distance[i]
+        propagate(row, distance[i - 1] if i > 0 else None)
+        row[:] = np.minimum.accumulate(row - ramp) + ramp
+
+    for i in range(n_rows - 1, -1, -1):
+        row = distance[i]
+        propagate(row, distance[i + 1] if i < n_rows - 1 else None)
+        row[:] = np.minimum.accumulate((row + ramp)[::-1])[::-1] - ramp
+
+    return distance
@@ -0,0 +1,229 @@
+"""Streaming temporal composites of local images."""
+
+from typing import Iterable
+
+import numpy as np
+
+from earthlib.buffers import asArray
+from earthlib.config import COMPOSITE_BINS, COMPOSITE_RANGE, TILE_ROWS
+
+
+class Compositor:
+    """Class for building per-pixel temporal composites one image at a time
+
+    Each added image updates running per-pixel reducers: a valid observation count,
+        a sum for the mean, an inverse-variance (1 / RMSE^2) weighted sum, and a
+        fixed-bin histogram sketch for approximate medians and percentiles. Memory use
+        is O(pixels x bins) regardless of how many images are added. Histogram bins
+        are uint16 to keep the sketch small, so a bin holds at most 65535
+        observations; add() raises a ValueError rather than wrapping around.
+
+    Attributes:
+        shape: the shape of each image, e.g. (rows, cols) or (n_bands, rows, cols)
+        bins: the number of histogram bins per pixel
+        value_range: the (min, max) values covered by the histogram. values outside
+            the range are counted in the first or last bin, and in clipped().
+    """
+
+    shape: tuple
+    bins: int
+    value_range: tuple
+
+    def __init__(
+        self,
+        shape: tuple,
+        bins: int = COMPOSITE_BINS,
+        value_range: tuple = COMPOSITE_RANGE,
+    ):
+        """Set up empty per-pixel reducers.
+
+        Args:
+            shape: the shape of each image, e.g. (rows, cols) or (n_bands, rows, cols).
+            bins: the number of histogram bins per pixel. percentile estimates are
+                accurate to (max - min) / bins.
+            value_range: the (min, max) values covered by the histogram.
+        """
+        self.shape = tuple(shape)
+        self.bins = bins
+        self.value_range = tuple(value_range)
+        self._count = np.zeros(self.shape, dtype=np.int32)
+        self._sum = np.zeros(self.shape, dtype=np.float64)
+        self._weighted_sum = np.zeros(self.shape, dtype=np.float64)
+        self._weights = np.zeros(self.shape, dtype=np.float64)
+        self._clipped = np.zeros(self.shape, dtype=np.int32)
+        self._histogram = np.zeros((bins,) + self.shape, dtype=np.uint16)
+        self._n_images = 0
+
+    def add(
+        self, values: np.ndarray, mask: np.ndarray = None, rmse: np.ndarray = None
+    ) -> None:
+        """Adds an image to the composite.
+
+        Args:
+            values: an array of `shape`. NaN values are skipped.
+            mask: an optional boolean array (broadcastable to `shape`) that is True for
+                valid pixels, e.g. from CloudMask.qaMaskLocal().
+            rmse: an optional per-pixel model error (broadcastable to `shape`), e.g. the
+                unmixing RMSE, to weight observations by in weightedMean().
+
+        Raises:
+            ValueError: when a histogram bin of a valid pixel is already full. the
+                composite is left unchanged.
+        """
+        values = asArray(values)
+        if values.shape != self.shape:
+            raise ValueError(
+                f"Shape mismatch: got {values.shape}, expected {self.shape}"
+            )
+
+        valid = ~np.isnan(values)
+        if mask is not None:
+            valid &= asArray(mask, dtype=bool)
+        values = np.where(valid, values, 0)
+
+        # each pixel lands in one bin, so pixel-wise fancy indexing has no duplicates
+        low, high = self.value_range
+        index = np.floor((values - low) * (self.bins / (high - low)))
+        index = np.clip(index, 0, self.bins - 1).astype(np.intp).ravel()
+        pixels = np.flatnonzero(valid)
+        flat = self._histogram.reshape(self.bins, -1)
+
+        # a bin can only be full once as many images as it holds have been added
+        limit = np.iinfo(flat.dtype).max
+        if self._n_images >= limit and (flat[index[pixels], pixels] == limit).any():
+            raise ValueError(
+                "Histogram bins are saturated. Add fewer images per composite"
+            )
+        self._n_images += 1
+        flat[index[pixels], pixels] += 1
+
+        self._count += valid
+        self._sum += values
+        self._clipped += valid & ((values < low) | (values > high))
+        if rmse is not None:
+            with np.errstate(divide="ignore"):
+                weights = 1 / np.square(asArray(rmse, dtype=np.float64))
+            weights = np.where(valid & np.isfinite(weights), weights, 0)
+            self._weighted_sum += weights * values
+            self._weights += weights
+
+    def addAll(self, images: Iterable) -> None:
+        """Adds a sequence of images, e.g. a generator reading one scene at a time.
+
+        Args:
+            images: an iterable of arrays, or of (values, mask, rmse) tuples.
+        """
+        for image in images:
+            if isinstance(image, tuple):
+                self.add(*image)
+            else:
+                self.add(image)
+
+    def count(self) -> np.ndarray:
+        """Returns the number of valid observations per pixel"""
+        return self._count.copy()
+
+    def clipped(self) -> np.ndarray:
+        """Returns the number of valid observations per pixel outside `value_range`.
+
+        Percentiles are only approximate where these are non-zero, since the clipped
+            values are binned at the edges of the range.
+        """
+        return self._clipped.copy()
+
+    def mean(self) -> np.ndarray:
+        """Returns the per-pixel mean of valid observations. NaN where there are none"""
+        with np.errstate(divide="ignore", invalid="ignore"):
+            return (self._sum / self._count).astype(np.float32)
+
+    def weightedMean(self) -> np.ndarray:
+        """Returns the per-pixel inverse-variance (1 / RMSE^2) weighted mean"""
+        with np.errstate(divide="ignore", invalid="ignore"):
+            return (self._weighted_sum / self._weights).astype(np.float32)
+
+    def median(self) -> np.ndarray:
+        """Returns the approximate per-pixel median of valid observations"""
+        return self.percentile(50)
+
+    def percentile(self, q: float, block_rows: int = TILE_ROWS) -> np.ndarray:
+        """Returns an approximate per-pixel percentile from the histogram sketches.
+
+        Values are linearly interpolated within the bin holding the percentile.
+
+        Args:
+            q: the percentile to estimate (0-100).
+            block_rows: the number of rows to estimate at a time, bounding the size of
+                the cumulative histogram held in memory.
+
+        Returns:
+            a float32 array of `shape`, NaN where there are no valid observations.
+        """
+        low, high = self.value_range
+        width = (high - low) / self.bins
+        histogram = self._histogram.reshape(self.bins, -1, self.shape[-1])
+        count = self._count.reshape(-1, self.shape[-1])
+        estimate = np.empty(count.shape, dtype=np.float32)
+
+        for start in range(0, count.shape[0], block_rows):
+            rows = slice(start, start + block_rows)
+            cumulative = np.cumsum(histogram[:, rows], axis=0, dtype=np.int32)
+
+            # find the first bin whose cumulative count reaches the target. the small
+            # floor keeps the 0th percentile in the first non-empty bin
+            target = np.maximum(count[rows] * (q / 100), 1e-6)
+            index = np.minimum((cumulative < target).sum(axis=0), self.bins - 1)
+            above = np.take_along_axis(cumulative, index[np.newaxis], axis=0)[0]
+            within = np.take_along_axis(histogram[:, rows], index[np.newaxis], 0)[0]
+            below = above - within
+            with np.errstate(divide="ignore", invalid="ignore"):
+                fraction = np.clip((target - below) / within, 0, 1)
+            fraction = np.where(within > 0, fraction, 0)
+            values = low + (index + fraction) * width
+            estimate[rows] = np.where(count[rows] > 0, values, np.nan)
+
+        return estimate.reshape(self.shape)
+
+    def result(self, percentiles: list = [50]) -> dict:
+        """Returns every composite product.
+
+        Args:
+            percentiles: the percentiles to estimate.
+
+        Returns:
+            a dictionary with "count", "mean", "weighted_mean" (if RMSE weights were
+                passed), "clipped" (if any values were outside `value_range`) and
+                "p{q}" percentile arrays.
+        """
+        results = {"count": self.count(), "mean": self.mean()}
+        if self._weights.any():
+            results["weighted_mean"] = self.weightedMean()
+        if self._clipped.any():
+            results["clipped"] = self.clipped()
+        for q in percentiles:
+            results[f"p{q:g}"] = self.percentile(q)
+        return results
+
+
+def composite(
+    images: Iterable,
+    shape: tuple,
+    percentiles: list = [50],
+    bins: int = COMPOSITE_BINS,
+    value_range: tuple = COMPOSITE_RANGE,
+) -> dict:
+    """Builds temporal composites from a stream of images.
+
+    Args:
+        images: an iterable of arrays, or of (values, mask, rmse) tuples, in the order
+            they are produced (e.g. one scene read at a time from a file list).
+        shape: the shape of each image, e.g. (rows, cols) or (n_bands, rows, cols).
+        percentiles: the percentiles to estimate.
+        bins: the number of histogram bins per pixel.
+        value_range: the (min, max) values covered by the histogram.
+
+    Returns:
+        a dictionary of composite products (see Compositor.result()).
+    """
+    compositor = Compositor(shape, bins, value_range)
+    compositor.addAll(images)
+    return compositor.result(percentiles)
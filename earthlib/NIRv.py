@@ -1,12 +1,39 @@
-"""Methods for computing NIRv (near infrared reflectance of vegetation) from ee.Image data"""
+"""Methods for computing NIRv (near infrared reflectance of vegetation) and other indices"""
 
+import ast
+import threading
+from concurrent.futures import ThreadPoolExecutor
 from typing import Callable
 
 import ee
-
-from earthlib.config import collections
+import numpy as np
+
+from earthlib import profiling
+from earthlib.buffers import asArray, asArrays, outputArray
+from earthlib.config import (
+    N_THREADS,
+    SPECTRAL_INDEX_ROLES,
+    SPECTRAL_INDEX_WAVELENGTHS,
+    SPECTRAL_INDICES,
+    TILE_ROWS,
+    collections,
+)
+from earthlib.errors import SensorError
 from earthlib.utils import getBandDescriptions, getBands
 
+# arithmetic operators supported in spectral index expressions
+OPERATORS = {
+    "Add": np.add,
+    "Sub": np.subtract,
+    "Mult": np.multiply,
+    "Div": np.divide,
+    "Pow": np.power,
+}
+
+# compiled spectral index programs, shared across calls
+_programs = dict()
+_program_lock = threading.Lock()
+
 
 def bySensor(sensor: str) -> Callable:
     """Returns the appropriate NIRv function to use by sensor type.
@@ -33,7 +60,7 @@ def bySensor(sensor: str) -> Callable:
     }
     try:
         function = lookup[sensor]
-        return function
+        return profiling.instrument(function, f"NIRv.{sensor}")
     except KeyError:
         supported = ", ".join(lookup.keys())
         raise SensorError(
@@ -153,3 +180,207 @@ def NIRvWrapper(image: ee.Image, red_band: str, nir_band: str) -> ee.Image:
     ndviScaled = ndvi.subtract(0.08)
     nirv = ndviScaled.multiply(nir).rename("NIRv")
     return image.addBands(nirv)
+
+
+@profiling.timed()
+def NIRvLocal(red: np.ndarray, nir: np.ndarray, out: np.ndarray = None) -> np.ndarray:
+    """Compute NIRv from local reflectance arrays, mirroring NIRvWrapper().
+
+    Args:
+        red: the red band reflectance.
+        nir: the near infrared band reflectance.
+        out: an optional float32 array to write NIRv to. may be `red` or `nir`.
+
+    Returns:
+        a float32 NIRv array.
+    """
+    red = asArray(red, dtype=np.float32)
+    nir = asArray(nir, dtype=np.float32)
+    out = outputArray(out, np.broadcast_shapes(red.shape, nir.shape), np.float32)
+    ndvi = nir + red
+    with np.errstate(divide="ignore", invalid="ignore"):
+        np.divide(nir - red, ndvi, out=ndvi)
+    ndvi -= 0.08
+    return np.multiply(ndvi, nir, out=out)
+
+
+def spectralIndices(image: ee.Image, sensor: str, indices: list = ["NIRv"]) -> ee.Image:
+    """Compute a series of spectral indices for an image.
+
+    Args:
+        image: the input image object.
+        sensor: the name of the sensor (from earthlib.listSensors()).
+        indices: the indices to compute (from config.SPECTRAL_INDICES).
+
+    Returns:
+        appends the input image with a band for each index.
+    """
+    compileIndices(indices)
+    roles = getIndexBands(sensor)
+    variables = {role: image.select(band) for role, band in roles.items()}
+    computed = [
+        image.expression(SPECTRAL_INDICES[name], variables).rename(name)
+        for name in indices
+    ]
+    return image.addBands(ee.Image.cat(computed))
+
+
+@profiling.timed()
+def spectralIndicesLocal(
+    bands: dict,
+    sensor: str,
+    indices: list = ["NIRv"],
+    block_rows: int = TILE_ROWS,
+    n_threads: int = N_THREADS,
+    out: dict = None,
+) -> dict:
+    """Compute a series of spectral indices from local reflectance arrays.
+
+    All indices are compiled into one program, so each band is read once per row
+        block and subexpressions shared between indices are only computed once.
+
+    Args:
+        bands: a dictionary of {band name: (rows, cols) reflectance array}.
+        sensor: the name of the sensor (from earthlib.listSensors()).
+        indices: the indices to compute (from config.SPECTRAL_INDICES).
+        block_rows: the number of rows computed at a time.
+        n_threads: the number of row blocks to compute concurrently.
+        out: an optional dictionary of {index name: float32 array} to write to.
+            indices not in the dictionary are allocated.
+
+    Returns:
+        a dictionary of {index name: float32 array}.
+    """
+    program, outputs = compileIndices(indices)
+    roles = getIndexBands(sensor)
+    variables = [instruction[1] for instruction in program if instruction[0] == "load"]
+    missing = [variable for variable in variables if variable not in roles]
+    if missing:
+        raise SensorError(f"{sensor} has no bands for index variables: {missing}")
+
+    bands = asArrays({roles[name]: bands[roles[name]] for name in variables})
+    shape = bands[roles[variables[0]]].shape
+    out = out or dict()
+    results = {name: outputArray(out.get(name), shape, np.float32) for name in indices}
+
+    def computeBlock(start):
+        stop = min(start + block_rows, shape[0])
+        block = {
+            variable: np.asarray(bands[roles[variable]][start:stop], dtype=np.float32)
+            for variable in variables
+        }
+        with np.errstate(divide="ignore", invalid="ignore"):
+            values = runProgram(program, outputs, block)
+        for name, value in values.items():
+            results[name][start:stop] = value
+
+    with ThreadPoolExecutor(max_workers=max(1, n_threads)) as executor:
+        list(executor.map(computeBlock, range(0, shape[0], block_rows)))
+
+    return results
+
+
+def getIndexBands(sensor: str) -> dict:
+    """Look-up the band name for each spectral index variable
+
+    Args:
+        sensor: the name of the sensor (from earthlib.listSensors()).
+
+    Returns:
+        a dictionary of {variable name (e.g. "nir"): band name}. sensors with several
+            bands per role (e.g. the ASTER swir bands) use the band nearest the role's
+            SPECTRAL_INDEX_WAVELENGTHS target.
+    """
+    bnames = getBands(sensor)
+    descriptions = getBandDescriptions(sensor)
+    centers = collections[sensor]["band_centers"]
+    roles, distances = dict(), dict()
+    for band, description, center in zip(bnames, descriptions, centers):
+        if description not in SPECTRAL_INDEX_ROLES:
+            continue
+        role = SPECTRAL_INDEX_ROLES[description]
+        distance = abs(center - SPECTRAL_INDEX_WAVELENGTHS[role])
+        if distance < distances.get(role, np.inf):
+            roles[role], distances[role] = band, distance
+    return roles
+
+
+def compileIndices(indices: list) -> tuple:
+    """Compiles spectral index expressions into a single instruction list.
+
+    Each instruction is ("load", variable), ("const", value), ("neg", register) or
+        (operator, register, register), and writes to the register at its position.
+        Identical subexpressions (e.g. nir - red in NDVI and NIRv) share a register.
+
+    Args:
+        indices: the indices to compute (from config.SPECTRAL_INDICES).
+
+    Returns:
+        (program, outputs): the instruction list and a dictionary mapping each index
+            name to the register holding its result.
+    """
+    key = tuple(indices)
+    with _program_lock:
+        if key in _programs:
+            return _programs[key]
+
+    program = list()
+    registers = dict()
+
+    def emit(node):
+        if isinstance(node, ast.Expression):
+            return emit(node.body)
+        elif isinstance(node, ast.Name):
+            instruction = ("load", node.id)
+        elif isinstance(node, ast.Constant) and isinstance(node.value, (int, float)):
+            instruction = ("const", float(node.value))
+        elif isinstance(node, ast.UnaryOp) and isinstance(node.op, ast.USub):
+            instruction = ("neg", emit(node.operand))
+        elif isinstance(node, ast.BinOp) and type(node.op).__name__ in OPERATORS:
+            instruction = (type(node.op).__name__, emit(node.left), emit(node.right))
+        else:
+            raise ValueError(f"Unsupported index expression syntax: {ast.dump(node)}")
+
+        if instruction not in registers:
+            registers[instruction] = len(program)
+            program.append(instruction)
+        return registers[instruction]
+
+    outputs = dict()
+    for name in indices:
+        if name not in SPECTRAL_INDICES:
+            supported = ", ".join(SPECTRAL_INDICES.keys())
+            raise ValueError(f"Invalid index: {name}. Supported: {supported}")
+        outputs[name] = emit(ast.parse(SPECTRAL_INDICES[name], mode="eval"))
+
+    with _program_lock:
+        _programs[key] = (program, outputs)
+
+    return program, outputs
+
+
+def runProgram(program: list, outputs: dict, variables: dict) -> dict:
+    """Evaluates a compiled spectral index program.
+
+    Args:
+        program: the instruction list from compileIndices().
+        outputs: the output registers from compileIndices().
+        variables: a dictionary of {variable name: array}.
+
+    Returns:
+        a dictionary of {index name: array}.
+    """
+    registers = list()
+    for instruction in program:
+        op = instruction[0]
+        if op == "load":
+            value = variables[instruction[1]]
+        elif op == "const":
+            value = np.float32(instruction[1])
+        elif op == "neg":
+            value = np.negative(registers[instruction[1]])
+        else:
+            value = OPERATORS[op](registers[instruction[1]], registers[instruction[2]])
+        registers.append(value)
+
+    return {name: registers[register] for name, register in outputs.items()}
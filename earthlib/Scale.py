@@ -3,8 +3,12 @@
 from typing import Callable
 
 import ee
+import numpy as np
 
-from earthlib.config import collections
+from earthlib import profiling
+from earthlib.buffers import asArray
+from earthlib.config import INT16_NODATA, REFLECTANCE_SCALE, collections
+from earthlib.errors import SensorError
 
 
 def bySensor(sensor: str) -> Callable:
@@ -33,7 +37,7 @@ def bySensor(sensor: str) -> Callable:
     }
     try:
         function = lookup[sensor]
-        return function
+        return profiling.instrument(function, f"Scale.{sensor}")
     except KeyError:
         supported = ", ".join(lookup.keys())
         raise SensorError(
@@ -139,16 +143,150 @@ def getScaleParams(sensor: str) -> tuple:
     return scale, offset
 
 
-def scaleWrapper(image: ee.Image, scale: float = 1, offset: float = 0) -> ee.Image:
+def scaleWrapper(
+    image: ee.Image, scale: float = 1, offset: float = 0, dtype: str = "float"
+) -> ee.Image:
     """Apply image rescaling and offset adjustments
 
     Args:
         image: the input image object
         scale: the image rescaling factor
         offset: the image offset factor
+        dtype: the output type. "int16" returns reflectance * REFLECTANCE_SCALE.
 
     Returns:
         the input rescaled as a 0-1 floating point image
     """
+    if dtype == "int16":
+        gain = scale * REFLECTANCE_SCALE
+        bias = offset * REFLECTANCE_SCALE
+        return image.multiply(gain).add(bias).round().toInt16()
+
     scaled = image.multiply(scale).add(offset)
     return scaled.toFloat()
+
+
+@profiling.timed()
+def scaleLocal(
+    dn: np.ndarray,
+    scale: float = 1,
+    offset: float = 0,
+    dtype: np.dtype = np.float32,
+    out: np.ndarray = None,
+) -> np.ndarray:
+    """Apply rescaling and offset adjustments to local raw DN values
+
+    Integer DNs scaled to int16 stay in the integer domain: the scale and offset are
+        converted to a fixed-point multiplier and bias, so no float copy of the band is
+        made. float16 outputs are computed in float32 and rounded once.
+
+    Args:
+        dn: the raw digital numbers (typically uint16), as any array buffer.
+        scale: the image rescaling factor (from getScaleParams()).
+        offset: the image offset factor (from getScaleParams()).
+        dtype: the output type. one of float64, float32, float16 (0-1 reflectance) or
+            int16 (reflectance * REFLECTANCE_SCALE). non-finite float inputs are set to
+            INT16_NODATA in int16 outputs.
+        out: an optional array to write the output to.
+
+    Returns:
+        the rescaled values.
+    """
+    dn = asArray(dn)
+    dtype = np.dtype(dtype)
+    if out is None:
+        out = np.empty(dn.shape, dtype=dtype)
+
+    if dtype == np.int16:
+        invalid = None
+        if np.issubdtype(dn.dtype, np.integer):
+            max_dn = max(abs(int(np.iinfo(dn.dtype).min)), int(np.iinfo(dn.dtype).max))
+            gain, bias, shift = fixedPointParams(scale, offset, max_dn)
+            scaled = dn.astype(np.int64 if max_dn > 0xFFFF else np.int32)
+            scaled *= gain
+            scaled += bias
+            scaled >>= shift
+        else:
+            scaled = np.multiply(dn, scale * REFLECTANCE_SCALE, dtype=np.float32)
+            scaled += offset * REFLECTANCE_SCALE
+            np.rint(scaled, out=scaled)
+            invalid = ~np.isfinite(scaled)
+            scaled[invalid] = 0
+        np.clip(scaled, -32767, 32767, out=scaled)
+        out[...] = scaled
+        if invalid is not None:
+            out[invalid] = INT16_NODATA
+    elif dtype == np.float16:
+        scaled = np.multiply(dn, np.float32(scale), dtype=np.float32)
+        scaled += np.float32(offset)
+        out[...] = scaled
+    elif dtype in (np.float32, np.float64):
+        np.multiply(dn, dtype.type(scale), out=out, dtype=dtype)
+        out += dtype.type(offset)
+    else:
+        supported = "float64, float32, float16, int16"
+        raise ValueError(f"Unsupported dtype: {dtype}. Supported: {supported}")
+
+    return out
+
+
+def toReflectance(values: np.ndarray, out: np.ndarray = None) -> np.ndarray:
+    """Convert scaled local values from scaleLocal() to 0-1 float32 reflectance
+
+    Args:
+        values: int16 (reflectance * REFLECTANCE_SCALE) or floating point reflectance.
+        out: an optional float32 array to write the output to.
+
+    Returns:
+        float32 reflectance. float32 inputs are returned without a copy, and
+            INT16_NODATA values are returned as NaN.
+    """
+    values = asArray(values)
+    if values.dtype == np.float32 and out is None:
+        return values
+
+    if np.issubdtype(values.dtype, np.integer):
+        inverse = np.float32(1 / REFLECTANCE_SCALE)
+        out = np.multiply(values, inverse, out=out, dtype=np.float32)
+        out[values == INT16_NODATA] = np.nan
+        return out
+
+    if out is None:
+        return values.astype(np.float32)
+    out[...] = values
+    return out
+
+
+def fixedPointParams(scale: float, offset: float, max_dn: int) -> tuple:
+    """Get the fixed-point multiplier, bias and shift for integer-domain int16 scaling
+
+    (dn * gain + bias) >> shift matches round((dn * scale + offset) * REFLECTANCE_SCALE)
+        to within one unit, with the shift as large as possible without overflowing
+        an int32 accumulator.
+
+    Args:
+        scale: the image rescaling factor.
+        offset: the image offset factor.
+        max_dn: the largest absolute DN value of the input type.
+
+    Returns:
+        (gain, bias, shift) integers.
+
+    Raises:
+        ValueError: when the scaled DN range overflows the accumulator even unshifted.
+    """
+    gain = scale * REFLECTANCE_SCALE
+    bias = offset * REFLECTANCE_SCALE
+    limit = 2**31 - 1 if max_dn <= 0xFFFF else 2**63 - 1
+    shift = 0
+    largest = max_dn * abs(gain) + abs(bias) + 1
+    if largest >= limit:
+        raise ValueError(
+            f"Scale {scale} and offset {offset} overflow fixed-point scaling of DNs "
+            f"up to {max_dn}. Scale to a float dtype instead"
+        )
+    while shift < 30 and largest * 2 ** (shift + 1) < limit:
+        shift += 1
+
+    rounding = 1 << (shift - 1) if shift > 0 else 0
+    return round(gain * 2**shift), round(bias * 2**shift) + rounding, shift
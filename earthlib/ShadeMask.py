@@ -4,6 +4,7 @@ from typing import Callable
 
 import ee
 
+from earthlib import profiling
 from earthlib.errors import SensorError
 from earthlib.utils import getBands
 
@@ -26,7 +27,7 @@ def bySensor(sensor: str) -> Callable:
     }
     try:
         function = lookup[sensor]
-        return function
+        return profiling.instrument(function, f"ShadeMask.{sensor}")
     except KeyError:
         supported = ", ".join(lookup.keys())
         raise SensorError(
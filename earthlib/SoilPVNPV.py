@@ -1,16 +1,22 @@
 """Methods for running Soil / Photosynthetic Vegetation / Non-Photosynthetic Vegetation unmixing."""
 
-from typing import Callable, Tuple
+from typing import Callable, Union
 
 import ee
+import numpy as np
 
-from earthlib.config import N_ITERATIONS, SHADE_NORMALIZE
+from earthlib import profiling
+from earthlib.config import BACKEND, N_ITERATIONS, RANDOM_SEED, SHADE_NORMALIZE
+from earthlib.errors import SensorError
 from earthlib.Unmix import fractionalCover
-from earthlib.utils import getBands, selectSpectra
+from earthlib.utils import getBands, unmixingEndmembers
 
 # default band names
 ENDMEMBER_NAMES = ["Soil", "PV", "NPV"]
 
+# endmember library types for each class, in ENDMEMBER_NAMES order
+ENDMEMBER_TYPES = ["bare", "vegetation", "npv"]
+
 
 def bySensor(sensor: str) -> Callable:
     """Returns the appropriate scaling function to use by sensor type.
@@ -38,7 +44,7 @@ def bySensor(sensor: str) -> Callable:
     }
     try:
         function = lookup[sensor]
-        return function
+        return profiling.instrument(function, f"SoilPVNPV.{sensor}")
     except KeyError:
         supported = ", ".join(lookup.keys())
         raise SensorError(
@@ -46,25 +52,27 @@ def bySensor(sensor: str) -> Callable:
         )
 
 
-def getEndmembers(sensor: str, bands: list, n: int = N_ITERATIONS) -> Tuple[list]:
-    """Get a series of ee.List objects with the SoilPVNPV endmembers.
+def getEndmembers(
+    sensor: str,
+    bands: list,
+    n: int = N_ITERATIONS,
+    backend: str = BACKEND,
+    seed: int = RANDOM_SEED,
+) -> Union[ee.Array, np.ndarray]:
+    """Get an array of the SoilPVNPV endmembers.
 
     Args:
         sensor: the name of the sensor (from earthlib.listSensors()).
         bands: a list of bands to select (from earthlib.getBands(sensor)).
         n: the number of iterations for unmixing.
+        backend: the processing backend. "local" returns a numpy array instead.
+        seed: the random seed for endmember selection.
 
     Returns:
-        (soil, pv, npv) endmembers
+        (soil, pv, npv) endmembers of shape (n, 3, n_bands): an ee.Array, or a
+            numpy array for the "local" backend.
     """
-    soil_list = selectSpectra("bare", sensor, n, bands)
-    pv_list = selectSpectra("vegetation", sensor, n, bands)
-    npv_list = selectSpectra("npv", sensor, n, bands)
-    soil = [ee.List(soil_spectra.tolist()) for soil_spectra in soil_list]
-    pv = [ee.List(pv_spectra.tolist()) for pv_spectra in pv_list]
-    npv = [ee.List(npv_spectra.tolist()) for npv_spectra in npv_list]
-
-    return soil, pv, npv
+    return unmixingEndmembers(ENDMEMBER_TYPES, sensor, bands, n, backend, seed)
 
 
 def ASTER(
@@ -72,6 +80,7 @@ def ASTER(
     bands: list = getBands("ASTER"),
     n: int = N_ITERATIONS,
     shade_normalize: bool = SHADE_NORMALIZE,
+    backend: str = BACKEND,
 ) -> ee.Image:
     """Unmix an ASTER image with soil, pv, npv endmembers.
 
@@ -81,19 +90,21 @@ def ASTER(
         n: the number of iterations for unmixing.
         shade_normalize: apply shade normalization during unmixing.
             reduces the influences of brightness and illumination geometry.
+        backend: the processing backend. use "local" to unmix a (bands, ...) numpy array.
 
     Returns:
         unmixed: a 3-band image with bands (%soil, %pv, %npv).
     """
     sensor = "ASTER"
     n_bands = len(bands)
-    endmembers = getEndmembers(sensor, bands, n)
+    endmembers = getEndmembers(sensor, bands, n, backend)
     unmixed = fractionalCover(
         img,
         endmembers,
         endmember_names=ENDMEMBER_NAMES,
         shade_normalize=shade_normalize,
         n_bands=n_bands,
+        backend=backend,
     )
 
     return unmixed
@@ -104,6 +115,7 @@ def AVNIR2(
     bands: list = getBands("AVNIR2"),
     n: int = N_ITERATIONS,
     shade_normalize: bool = SHADE_NORMALIZE,
+    backend: str = BACKEND,
 ) -> ee.Image:
     """Unmix an AVNIR2 image with soil, pv, npv endmembers.
 
@@ -113,19 +125,21 @@ def AVNIR2(
         n: the number of iterations for unmixing.
         shade_normalize: apply shade normalization during unmixing.
             reduces the influences of brightness and illumination geometry.
+        backend: the processing backend. use "local" to unmix a (bands, ...) numpy array.
 
     Returns:
         unmixed: a 3-band image with bands (%soil, %pv, %npv).
     """
     sensor = "AVNIR2"
     n_bands = len(bands)
-    endmembers = getEndmembers(sensor, bands, n)
+    endmembers = getEndmembers(sensor, bands, n, backend)
     unmixed = fractionalCover(
         img,
         endmembers,
         endmember_names=ENDMEMBER_NAMES,
         shade_normalize=shade_normalize,
         n_bands=n_bands,
+        backend=backend,
     )
 
     return unmixed
@@ -136,6 +150,7 @@ def DoveR(
     bands: list = getBands("DoveR"),
     n: int = N_ITERATIONS,
     shade_normalize: bool = SHADE_NORMALIZE,
+    backend: str = BACKEND,
 ) -> ee.Image:
     """Unmix a Landsat8 image with soil, pv, npv endmembers.
 
@@ -145,19 +160,21 @@ def DoveR(
         n: the number of iterations for unmixing.
         shade_normalize: apply shade normalization during unmixing.
             reduces the influences of brightness and illumination geometry.
+        backend: the processing backend. use "local" to unmix a (bands, ...) numpy array.
 
     Returns:
         unmixed: a 3-band image with bands (%soil, %pv, %npv).
     """
     sensor = "DoveR"
     n_bands = len(bands)
-    endmembers = getEndmembers(sensor, bands, n)
+    endmembers = getEndmembers(sensor, bands, n, backend)
     unmixed = fractionalCover(
         img,
         endmembers,
         endmember_names=ENDMEMBER_NAMES,
         shade_normalize=shade_normalize,
         n_bands=n_bands,
+        backend=backend,
     )
 
     return unmixed
@@ -168,6 +185,7 @@ def Landsat457(
     bands: list = getBands("Landsat7"),
     n: int = N_ITERATIONS,
     shade_normalize: bool = SHADE_NORMALIZE,
+    backend: str = BACKEND,
 ) -> ee.Image:
     """Unmix a Landsat4 image with soil, pv, npv endmembers.
 
@@ -177,19 +195,21 @@ def Landsat457(
         n: the number of iterations for unmixing.
         shade_normalize: apply shade normalization during unmixing.
             reduces the influences of brightness and illumination geometry.
+        backend: the processing backend. use "local" to unmix a (bands, ...) numpy array.
 
     Returns:
         unmixed: a 3-band image with bands (%soil, %pv, %npv).
     """
     sensor = "Landsat7"
     n_bands = len(bands)
-    endmembers = getEndmembers(sensor, bands, n)
+    endmembers = getEndmembers(sensor, bands, n, backend)
     unmixed = fractionalCover(
         img,
         endmembers,
         endmember_names=ENDMEMBER_NAMES,
         shade_normalize=shade_normalize,
         n_bands=n_bands,
+        backend=backend,
     )
 
     return unmixed
@@ -200,6 +220,7 @@ def Landsat8(
     bands: list = getBands("Landsat8"),
     n: int = N_ITERATIONS,
     shade_normalize: bool = SHADE_NORMALIZE,
+    backend: str = BACKEND,
 ) -> ee.Image:
     """Unmix a Landsat8 image with soil, pv, npv endmembers.
 
@@ -209,19 +230,21 @@ def Landsat8(
         n: the number of iterations for unmixing.
         shade_normalize: apply shade normalization during unmixing.
             reduces the influences of brightness and illumination geometry.
+        backend: the processing backend. use "local" to unmix a (bands, ...) numpy array.
 
     Returns:
         unmixed: a 3-band image with bands (%soil, %pv, %npv).
     """
     sensor = "Landsat8"
     n_bands = len(bands)
-    endmembers = getEndmembers(sensor, bands, n)
+    endmembers = getEndmembers(sensor, bands, n, backend)
     unmixed = fractionalCover(
         img,
         endmembers,
         endmember_names=ENDMEMBER_NAMES,
         shade_normalize=shade_normalize,
         n_bands=n_bands,
+        backend=backend,
     )
 
     return unmixed
@@ -232,6 +255,7 @@ def MODIS(
     bands: list = getBands("MODIS"),
     n: int = N_ITERATIONS,
     shade_normalize: bool = SHADE_NORMALIZE,
+    backend: str = BACKEND,
 ) -> ee.Image:
     """Unmix a MODIS image with soil, pv, npv endmembers.
 
@@ -241,19 +265,21 @@ def MODIS(
         n: the number of iterations for unmixing.
         shade_normalize: apply shade normalization during unmixing.
             reduces the influences of brightness and illumination geometry.
+        backend: the processing backend. use "local" to unmix a (bands, ...) numpy array.
 
     Returns:
         unmixed: a 3-band image with bands (%soil, %pv, %npv).
     """
     sensor = "MODIS"
     n_bands = len(bands)
-    endmembers = getEndmembers(sensor, bands, n)
+    endmembers = getEndmembers(sensor, bands, n, backend)
     unmixed = fractionalCover(
         img,
         endmembers,
         endmember_names=ENDMEMBER_NAMES,
         shade_normalize=shade_normalize,
         n_bands=n_bands,
+        backend=backend,
     )
 
     return unmixed
@@ -264,6 +290,7 @@ def NEON(
     bands: list = getBands("NEON"),
     n: int = N_ITERATIONS,
     shade_normalize: bool = SHADE_NORMALIZE,
+    backend: str = BACKEND,
 ) -> ee.Image:
     """Unmix a NEON image with soil, pv, npv endmembers.
 
@@ -273,19 +300,21 @@ def NEON(
         n: the number of iterations for unmixing.
         shade_normalize: apply shade normalization during unmixing.
             reduces the influences of brightness and illumination geometry.
+        backend: the processing backend. use "local" to unmix a (bands, ...) numpy array.
 
     Returns:
         unmixed: a 3-band image with bands (%soil, %pv, %npv).
     """
     sensor = "NEON"
     n_bands = len(bands)
-    endmembers = getEndmembers(sensor, bands, n)
+    endmembers = getEndmembers(sensor, bands, n, backend)
     unmixed = fractionalCover(
         img,
         endmembers,
         endmember_names=ENDMEMBER_NAMES,
         shade_normalize=shade_normalize,
         n_bands=n_bands,
+        backend=backend,
     )
 
     return unmixed
@@ -296,6 +325,7 @@ def PlanetScope(
     bands: list = getBands("PlanetScope"),
     n: int = N_ITERATIONS,
     shade_normalize: bool = SHADE_NORMALIZE,
+    backend: str = BACKEND,
 ) -> ee.Image:
     """Unmix a PlanetScope image with soil, pv, npv endmembers.
 
@@ -305,19 +335,21 @@ def PlanetScope(
         n: the number of iterations for unmixing.
         shade_normalize: apply shade normalization during unmixing.
             reduces the influences of brightness and illumination geometry.
+        backend: the processing backend. use "local" to unmix a (bands, ...) numpy array.
 
     Returns:
         unmixed: a 3-band image with bands (%soil, %pv, %npv).
     """
     sensor = "PlanetScope"
     n_bands = len(bands)
-    endmembers = getEndmembers(sensor, bands, n)
+    endmembers = getEndmembers(sensor, bands, n, backend)
     unmixed = fractionalCover(
         img,
         endmembers,
         endmember_names=ENDMEMBER_NAMES,
         shade_normalize=shade_normalize,
         n_bands=n_bands,
+        backend=backend,
     )
 
     return unmixed
@@ -328,6 +360,7 @@ def Sentinel2(
     bands: list = getBands("Sentinel2"),
     n: int = N_ITERATIONS,
     shade_normalize: bool = SHADE_NORMALIZE,
+    backend: str = BACKEND,
 ) -> ee.Image:
     """Unmix a Sentinel2 image with soil, pv, npv endmembers.
 
@@ -337,19 +370,21 @@ def Sentinel2(
         n: the number of iterations for unmixing.
         shade_normalize: apply shade normalization during unmixing.
             reduces the influences of brightness and illumination geometry.
+        backend: the processing backend. use "local" to unmix a (bands, ...) numpy array.
 
     Returns:
         unmixed: a 3-band image with bands (%soil, %pv, %npv).
     """
     sensor = "Sentinel2"
     n_bands = len(bands)
-    endmembers = getEndmembers(sensor, bands, n)
+    endmembers = getEndmembers(sensor, bands, n, backend)
     unmixed = fractionalCover(
         img,
         endmembers,
         endmember_names=ENDMEMBER_NAMES,
         shade_normalize=shade_normalize,
         n_bands=n_bands,
+        backend=backend,
     )
 
     return unmixed
@@ -360,6 +395,7 @@ def SuperDove(
     bands: list = getBands("SuperDove"),
     n: int = N_ITERATIONS,
     shade_normalize: bool = SHADE_NORMALIZE,
+    backend: str = BACKEND,
 ) -> ee.Image:
     """Unmix a SuperDove image with soil, pv, npv endmembers.
 
@@ -369,19 +405,21 @@ def SuperDove(
         n: the number of iterations for unmixing.
         shade_normalize: apply shade normalization during unmixing.
             reduces the influences of brightness and illumination geometry.
+        backend: the processing backend. use "local" to unmix a (bands, ...) numpy array.
 
     Returns:
         unmixed: a 3-band image with bands (%soil, %pv, %npv).
     """
     sensor = "SuperDove"
     n_bands = len(bands)
-    endmembers = getEndmembers(sensor, bands, n)
+    endmembers = getEndmembers(sensor, bands, n, backend)
     unmixed = fractionalCover(
         img,
         endmembers,
         endmember_names=ENDMEMBER_NAMES,
         shade_normalize=shade_normalize,
         n_bands=n_bands,
+        backend=backend,
     )
 
     return unmixed
@@ -392,6 +430,7 @@ def VIIRS(
     bands: list = getBands("VIIRS"),
     n: int = N_ITERATIONS,
     shade_normalize: bool = SHADE_NORMALIZE,
+    backend: str = BACKEND,
 ) -> ee.Image:
     """Unmix a VIIRS image with soil, pv, npv endmembers.
 
@@ -401,19 +440,21 @@ def VIIRS(
         n: the number of iterations for unmixing.
         shade_normalize: apply shade normalization during unmixing.
             reduces the influences of brightness and illumination geometry.
+        backend: the processing backend. use "local" to unmix a (bands, ...) numpy array.
 
     Returns:
         unmixed: a 3-band image with bands (%soil, %pv, %npv).
     """
     sensor = "VIIRS"
     n_bands = len(bands)
-    endmembers = getEndmembers(sensor, bands, n)
+    endmembers = getEndmembers(sensor, bands, n, backend)
     unmixed = fractionalCover(
         img,
         endmembers,
         endmember_names=ENDMEMBER_NAMES,
         shade_normalize=shade_normalize,
         n_bands=n_bands,
+        backend=backend,
     )
 
     return unmixed
@@ -1,11 +1,24 @@
 """Functions for cloud masking earth engine images based on band thresholds."""
 
+from concurrent.futures import ThreadPoolExecutor
 from typing import Callable
 
 import ee
+import numpy as np
 
+from earthlib import profiling
+from earthlib.buffers import asArrays, outputArray
+from earthlib.config import N_THREADS, THRESHOLD_TESTS, TILE_ROWS
 from earthlib.errors import SensorError
 
+# comparison operators supported in threshold test tables
+COMPARISONS = {
+    "gt": np.greater,
+    "gte": np.greater_equal,
+    "lt": np.less,
+    "lte": np.less_equal,
+}
+
 
 def bySensor(sensor: str) -> Callable:
     """Returns the appropriate cloud mask function to use by sensor type.
@@ -26,7 +39,7 @@ def bySensor(sensor: str) -> Callable:
     }
     try:
         function = lookup[sensor]
-        return function
+        return profiling.instrument(function, f"ThresholdMask.{sensor}")
     except KeyError:
         supported = ", ".join(lookup.keys())
         raise SensorError(
@@ -46,36 +59,8 @@ def Landsat457(img: ee.Image, probability_threshold: float = 0.4) -> ee.Image:
     Returns:
         the same input image with an updated mask.
     """
-    # band specifications
-    blue = img.select("SR_B1")
-    green = img.select("SR_B2")
-    red = img.select("SR_B3")
-    nir = img.select("SR_B4")
-    swir1 = img.select("SR_B5")
-    swir2 = img.select("SR_B7")
-
-    # single band thresholds
-    s1 = blue.gt(0.2)
-    s2 = green.gt(0.2)
-    s3 = red.gt(0.21)
-    s4 = swir1.gt(0.29)
-    s5 = swir2.gt(0.25)
-
-    # multi-band thresholds
-    m3 = blue.gt(0.16).And(nir.gt(0.26))
-    m4 = blue.gt(0.20).And(swir1.gt(0.20))
-    m5 = green.gt(0.12).And(nir.gt(0.32))
-    m6 = red.gt(0.14).And(nir.gt(0.35))
-    m7 = nir.gt(0.40).And(swir1.gt(0.30))
-
-    # band ratio
-    ratio = swir1.divide(swir2)
-    ratio_thresh = ratio.gt(0.91).And(ratio.lt(1.83))
-
-    # merge and average the results
-    stack = s1.addBands([s2, s3, s4, s5, m1, m2, m3, m4, m5, m6, m7, ratio_thresh])
-    probability = stack.reduce(ee.Reducer.mean())
-    mask = probability.lt(probability_threshold)
+    tests = THRESHOLD_TESTS["Landsat457"]["tests"]
+    mask = probabilityMask(img, tests, probability_threshold)
 
     return img.updateMask(mask)
 
@@ -92,39 +77,8 @@ def Landsat8(img: ee.Image, probability_threshold: float = 0.4) -> ee.Image:
     Returns:
         the same input image with an updated mask.
     """
-    # band specifications
-    ultrablue = img.select("SR_B1")
-    blue = img.select("SR_B2")
-    green = img.select("SR_B3")
-    red = img.select("SR_B4")
-    nir = img.select("SR_B5")
-    swir1 = img.select("SR_B6")
-    swir2 = img.select("SR_B7")
-
-    # single band thresholds
-    s1 = blue.gt(0.2)
-    s2 = green.gt(0.2)
-    s3 = red.gt(0.21)
-    s4 = swir1.gt(0.29)
-    s5 = swir2.gt(0.25)
-
-    # multi-band thresholds
-    m1 = ultrablue.gt(0.24).And(nir.gt(0.26))
-    m2 = ultrablue.gt(0.24).And(swir1.gt(0.20))
-    m3 = blue.gt(0.16).And(nir.gt(0.26))
-    m4 = blue.gt(0.20).And(swir1.gt(0.20))
-    m5 = green.gt(0.12).And(nir.gt(0.32))
-    m6 = red.gt(0.14).And(nir.gt(0.35))
-    m7 = nir.gt(0.40).And(swir1.gt(0.30))
-
-    # band ratio
-    ratio = swir1.divide(swir2)
-    ratio_thresh = ratio.gt(0.91).And(ratio.lt(1.83))
-
-    # merge and average the results
-    stack = s1.addBands([s2, s3, s4, s5, m1, m2, m3, m4, m5, m6, m7, ratio_thresh])
-    probability = stack.reduce(ee.Reducer.mean())
-    mask = probability.lt(probability_threshold)
+    tests = THRESHOLD_TESTS["Landsat8"]["tests"]
+    mask = probabilityMask(img, tests, probability_threshold)
 
     return img.updateMask(mask)
 
@@ -141,33 +95,8 @@ def MODIS(img: ee.Image, probability_threshold: float = 0.6) -> ee.Image:
     Returns:
         the same input image with an updated mask.
     """
-    # band specifications
-    b1 = img.select("sur_refl_b01")
-    b2 = img.select("sur_refl_b02")
-    b3 = img.select("sur_refl_b03")
-    b4 = img.select("sur_refl_b04")
-    b5 = img.select("sur_refl_b05")
-    b6 = img.select("sur_refl_b06")
-    b7 = img.select("sur_refl_b07")
-
-    # single band thresholds
-    s1 = b1.gt(0.29)
-    s2 = b3.gt(0.23)
-    s3 = b4.gt(0.24)
-
-    # multi-band thresholds
-    m1 = b1.gt(0.28).And(b5.gt(0.24))
-    m2 = b1.gt(0.28).And(b6.gt(0.16))
-    m3 = b3.gt(0.28).And(b7.gt(0.08))
-
-    # band ratios
-    ratio = b2.divide(b1)
-    ratio_thresh = ratio.gt(0.95).And(ratio.lt(1.15))
-
-    # merge and average the results
-    stack = s1.addBands([s2, s3, m1, m2, m3, ratio_thresh])
-    probability = stack.reduce(ee.Reducer.mean())
-    mask = probability.lt(probability_threshold)
+    tests = THRESHOLD_TESTS["MODIS"]["tests"]
+    mask = probabilityMask(img, tests, probability_threshold)
 
     return img.updateMask(mask)
 
@@ -184,63 +113,171 @@ def VIIRS(img: ee.Image, probability_threshold: float = 0.4) -> ee.Image:
     Returns:
         the same input image with an updated mask.
     """
-    # band specifications
-    b1 = img.select("M1")
-    b2 = img.select("M2")
-    b3 = img.select("M3")
-    b4 = img.select("M4")
-    b5 = img.select("M5")
-    b6 = img.select("M6")
-    b7 = img.select("M7")
-    b8 = img.select("M8")
-
-    # single band thresholds
-    s1 = b1.gt(0.31)
-    s2 = b2.gt(0.25)
-    s3 = b3.gt(0.25)
-    s4 = b4.gt(0.25)
-    s5 = b5.gt(0.30)
-    s6 = b7.gt(0.52)
-    s7 = b8.gt(0.46)
-
-    # multi-band thresholds
-    m1 = b1.gt(0.29).And(b7.gt(0.30))
-    m2 = b1.gt(0.29).And(b8.gt(0.22))
-    m3 = b1.gt(0.31).And(b10.gt(0.08))
-    m4 = b1.gt(0.29).And(b11.gt(0.12))
-    m5 = b2.gt(0.27).And(b8.gt(0.22))
-    m6 = b2.gt(0.72).And(b10.gt(0.14))
-    m7 = b3.gt(0.23).And(b8.gt(0.24))
-    m8 = b3.gt(0.16).And(b9.gt(0.08))
-
-    # band ratios
-    ratio1 = b6.divide(b4)
-    ratio2 = b7.divide(b5)
-    ratio1_thresh = ratio1.gt(0.12).And(ratio1.lt(0.48))
-    ratio2_thresh = ratio2.gt(1.0).And(ratio2.lt(1.15))
-
-    # merge and average the results
-    stack = s1.addBands(
-        [
-            s2,
-            s3,
-            s4,
-            s5,
-            s6,
-            s7,
-            m1,
-            m2,
-            m3,
-            m4,
-            m5,
-            m6,
-            m7,
-            m8,
-            ratio1_thresh,
-            ratio2_thresh,
-        ]
-    )
-    probability = stack.reduce(ee.Reducer.mean())
-    mask = probability.lt(probability_threshold)
+    tests = THRESHOLD_TESTS["VIIRS"]["tests"]
+    mask = probabilityMask(img, tests, probability_threshold)
 
     return img.updateMask(mask)
+
+
+def probabilityMask(
+    img: ee.Image, tests: list, probability_threshold: float
+) -> ee.Image:
+    """Computes the fraction of threshold tests passed and applies a mask threshold.
+
+    Args:
+        img: the ee.Image with the bands referenced in `tests`.
+        tests: a list of threshold tests (e.g. from config.THRESHOLD_TESTS).
+        probability_threshold: the cloud probability to mask at or above.
+
+    Returns:
+        a mask that is 1 where the cloud probability is below the threshold.
+    """
+    results = list()
+    for conditions in tests:
+        result = None
+        for band, comparison, value in conditions:
+            passed = getattr(selectBand(img, band), comparison)(value)
+            result = passed if result is None else result.And(passed)
+        results.append(result)
+
+    stack = ee.Image.cat(results)
+    probability = stack.reduce(ee.Reducer.mean())
+
+    return probability.lt(probability_threshold)
+
+
+def selectBand(img: ee.Image, band: str) -> ee.Image:
+    """Selects a band or an "A/B" band ratio from an image."""
+    if "/" in band:
+        numerator, denominator = band.split("/")
+        return img.select(numerator).divide(img.select(denominator))
+
+    return img.select(band)
+
+
+@profiling.timed()
+def thresholdMaskLocal(
+    bands: dict,
+    sensor: str,
+    probability_threshold: float = None,
+    block_rows: int = TILE_ROWS,
+    n_threads: int = N_THREADS,
+    out: np.ndarray = None,
+) -> np.ndarray:
+    """Computes a threshold-based cloud mask from local reflectance arrays.
+
+    Every test is evaluated one row block at a time and the number of passing tests is
+        accumulated in a uint8 counter, so the per-test results are never stacked.
+        The counts are compared against the smallest count whose mean test result
+        reaches the threshold (see countLimit()).
+
+    Args:
+        bands: a dictionary of {band name: (rows, cols) scaled reflectance array}.
+        sensor: the sensor name (e.g. "Landsat8") or a config.THRESHOLD_TESTS key.
+        probability_threshold: the cloud probability to mask at or above.
+            defaults to the sensor's value in config.THRESHOLD_TESTS.
+        block_rows: the number of rows evaluated at a time.
+        n_threads: the number of row blocks to evaluate concurrently.
+        out: an optional (rows, cols) boolean array to write the mask to.
+
+    Returns:
+        a boolean mask that is True where the cloud probability is below the threshold.
+    """
+    rules = getTests(sensor)
+    tests = rules["tests"]
+    if probability_threshold is None:
+        probability_threshold = rules["probability_threshold"]
+
+    for conditions in tests:
+        for band, comparison, value in conditions:
+            if comparison not in COMPARISONS:
+                supported = ", ".join(COMPARISONS.keys())
+                raise ValueError(
+                    f"Unsupported comparison: {comparison}. Supported: {supported}"
+                )
+
+    limit = countLimit(probability_threshold, len(tests))
+    first = tests[0][0][0].split("/")[0]
+    bands = asArrays(bands)
+    shape = bands[first].shape
+    mask = outputArray(out, shape, bool)
+
+    def maskBlock(start):
+        stop = min(start + block_rows, shape[0])
+        block = dict()
+        count = np.zeros((stop - start, shape[1]), dtype=np.uint8)
+        passed = np.empty(count.shape, dtype=bool)
+        condition = np.empty(count.shape, dtype=bool)
+        for conditions in tests:
+            passed[:] = True
+            for band, comparison, value in conditions:
+                if band not in block:
+                    block[band] = blockValues(bands, band, start, stop)
+                COMPARISONS[comparison](block[band], value, out=condition)
+                passed &= condition
+            count += passed
+        mask[start:stop] = count < limit
+        if profiling.isEnabled():
+            clear = np.count_nonzero(mask[start:stop])
+            profiling.count("ThresholdMask.pixels", count.size)
+            profiling.count("ThresholdMask.masked", count.size - clear)
+
+    with ThreadPoolExecutor(max_workers=max(1, n_threads)) as executor:
+        list(executor.map(maskBlock, range(0, shape[0], block_rows)))
+
+    return mask
+
+
+def blockValues(bands: dict, band: str, start: int, stop: int) -> np.ndarray:
+    """Gets a block of rows for a band or an "A/B" band ratio."""
+    if "/" in band:
+        numerator, denominator = band.split("/")
+        with np.errstate(divide="ignore", invalid="ignore"):
+            return np.divide(
+                bands[numerator][start:stop],
+                bands[denominator][start:stop],
+                dtype=np.float32,
+            )
+
+    return bands[band][start:stop]
+
+
+def countLimit(probability_threshold: float, n_tests: int) -> int:
+    """Gets the number of passed tests at which the cloud probability hits a threshold.
+
+    The probability is compared as count / n_tests, like the mean reducer in
+        probabilityMask(), rather than as count < threshold * n_tests, which rounds
+        differently (e.g. 0.28 * 25 > 7).
+
+    Args:
+        probability_threshold: the cloud probability to mask at or above.
+        n_tests: the number of threshold tests.
+
+    Returns:
+        the smallest count with count / n_tests >= probability_threshold, or
+            n_tests + 1 if no count reaches the threshold.
+    """
+    for count in range(n_tests + 1):
+        if count / n_tests >= probability_threshold:
+            return count
+    return n_tests + 1
+
+
+def getTests(sensor: str) -> dict:
+    """Returns the threshold test table to use by sensor type.
+
+    Args:
+        sensor: the sensor name (e.g. "Landsat8") or a config.THRESHOLD_TESTS key.
+
+    Returns:
+        a dictionary with the "tests" and default "probability_threshold".
+    """
+    landsat = ["Landsat4", "Landsat5", "Landsat7"]
+    key = "Landsat457" if sensor in landsat else sensor
+    try:
+        return THRESHOLD_TESTS[key]
+    except KeyError:
+        supported = ", ".join(landsat + list(THRESHOLD_TESTS.keys()))
+        raise SensorError(
+            f"Cloud masking not supported for '{sensor}'. Supported: {supported}"
+        )
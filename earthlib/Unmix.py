@@ -1,32 +1,66 @@
 """Routines for performing spectral unmixing on earth engine images."""
 
+import hashlib
+import itertools
+import threading
+from collections import OrderedDict
+from concurrent.futures import ThreadPoolExecutor
 from typing import Callable
 
 import ee
-
-from earthlib.config import RMSE, WEIGHT
-from earthlib.utils import selectSpectra
-
-
+import numpy as np
+
+from earthlib import profiling
+from earthlib.buffers import arrayModule, asArray, outputArray, toDevice
+from earthlib.config import (
+    BACKEND,
+    BLOCK_SIZE,
+    DEVICE,
+    FACTORIZATION_CACHE_SIZE,
+    FCLS_TOLERANCE,
+    GPU_BLOCK_SIZE,
+    N_THREADS,
+    RMSE,
+    WEIGHT,
+)
+from earthlib.utils import selectSpectra, validateBackend, validateDevice
+
+# factorized endmember draws, shared by every local unmixing call in the process
+_operator_cache = OrderedDict()
+_operator_lock = threading.Lock()
+
+
+@profiling.timed()
 def fractionalCover(
     img: ee.Image,
     endmembers: list,
     endmember_names: list,
     n_bands: int = None,
     shade_normalize: bool = True,
+    backend: str = BACKEND,
 ) -> ee.Image:
     """Computes the percent cover of each endmember spectra.
 
     Args:
         img: the ee.Image to unmix.
         endmembers: lists of ee.List objects, each element corresponding to a subType.
+            an ee.Array of shape (n_iterations, n_classes, n_bands) is unmixed with
+            fractionalCoverArray().
         endmember_names: list of names for each endmember. must match the number of lists passed.
         n_bands: number of reflectance bands used for unmixing.
         shade_normalize: flag to apply shade normalization during unmixing.
+        backend: the processing backend. "local" unmixes a numpy array with fractionalCoverLocal().
 
     Returns:
         unmixed: a 3-band image file in order of (soil-veg-impervious).
     """
+    validateBackend(backend)
+    if backend == "local":
+        return fractionalCoverLocal(img, endmembers, shade_normalize=shade_normalize)
+
+    if isinstance(endmembers, ee.Array):
+        return fractionalCoverArray(img, endmembers, endmember_names, shade_normalize)
+
     if n_bands is None:
         n_bands = len(list(img.bandNames().getInfo()))
     n_classes = len(endmembers)
@@ -58,6 +92,10 @@ def fractionalCover(
             unmixed_iter.select(band_numbers, endmember_names).addBands(rmse)
         )
 
+    # a single draw has nothing to weight against
+    if len(unmixed) == 1:
+        return unmixed[0].select(endmember_names).toFloat()
+
     # use the sum of rmse to weight each estimate
     rmse_sum = ee.Image(
         ee.ImageCollection.fromImages(unmixed).select([RMSE]).sum().select([0], ["SUM"])
@@ -79,6 +117,83 @@ def fractionalCover(
     return unmixed
 
 
+def fractionalCoverArray(
+    img: ee.Image,
+    endmembers: ee.Array,
+    endmember_names: list,
+    shade_normalize: bool = True,
+) -> ee.Image:
+    """Computes the percent cover of each endmember from a single endmember array.
+
+    Runs the same algorithm as fractionalCover(), but maps each iteration over a
+        server-side sequence instead of building one unmixing graph per draw in python.
+        The endmembers are one constant in the request, the graph size doesn't grow with
+        the number of iterations, and no getInfo() calls are made, so it is safe to use
+        inside an ee.ImageCollection .map() call.
+
+    Args:
+        img: the ee.Image to unmix, with one band per endmember band.
+        endmembers: an ee.Array of shape (n_iterations, n_classes, n_bands)
+            (e.g. from earthlib.utils.endmemberArray()).
+        endmember_names: list of names for each endmember class.
+        shade_normalize: flag to apply shade normalization during unmixing.
+
+    Returns:
+        unmixed: an image with the fractional cover of each class.
+    """
+    n_classes = len(endmember_names)
+    band_numbers = list(range(n_classes))
+    n_iterations = ee.Number(endmembers.length().get([0]))
+    measured = img.toArray().toArray(1)
+
+    def unmixIteration(i):
+        i = ee.Number(i)
+        spectra = endmembers.slice(0, i, i.add(1)).project([1, 2])
+        if shade_normalize:
+            shade = spectra.slice(0, 0, 1).multiply(0)
+            spectra = ee.Array.cat([spectra, shade], 0)
+
+        unmixed_iter = img.unmix(spectra.toList(), True, True)
+
+        # run the forward model as (n_bands, n_endmembers) x (n_endmembers, 1)
+        fractions = unmixed_iter.toArray().toArray(1)
+        modeled = ee.Image(spectra.transpose()).matrixMultiply(fractions)
+        rmse = (
+            measured.subtract(modeled)
+            .pow(2)
+            .arrayReduce(ee.Reducer.sum(), [0])
+            .arrayGet([0, 0])
+            .sqrt()
+            .rename(RMSE)
+        )
+
+        # normalize by the observed shade fraction
+        if shade_normalize:
+            shade_fraction = unmixed_iter.select([n_classes]).subtract(1).abs()
+            unmixed_iter = unmixed_iter.divide(shade_fraction)
+
+        return unmixed_iter.select(band_numbers, endmember_names).addBands(rmse)
+
+    unmixed = ee.ImageCollection.fromImages(
+        ee.List.sequence(0, n_iterations.subtract(1)).map(unmixIteration)
+    )
+
+    # use the sum of rmse to weight each estimate
+    rmse_sum = unmixed.select([RMSE]).sum().select([0], ["SUM"])
+    unscaled = unmixed.map(lambda fractions: computeWeight(fractions, rmse_sum))
+
+    # use these weights to scale each unmixing estimate
+    weight_sum = unscaled.select([WEIGHT]).sum()
+    scaled = unscaled.map(
+        lambda fractions: weightedAverage(fractions, weight_sum, endmember_names)
+    )
+
+    # a single draw has nothing to weight against
+    single = unmixed.first().select(endmember_names)
+    unmixed = ee.Algorithms.If(n_iterations.eq(1), single, scaled.sum())
+    return ee.Image(unmixed).toFloat()
+
+
 def computeModeledSpectra(
     endmembers: list, fractions: ee.Image, n_bands: int
 ) -> ee.Image:
@@ -189,3 +304,350 @@ def weightedAverage(
     weighted = fractions.select(band_range, band_names).multiply(scaler)
 
     return weighted
+
+
+@profiling.timed()
+def fractionalCoverLocal(
+    array: np.ndarray,
+    endmembers: list,
+    shade_normalize: bool = True,
+    mask: np.ndarray = None,
+    block_size: int = BLOCK_SIZE,
+    n_threads: int = N_THREADS,
+    out: np.ndarray = None,
+    device: str = DEVICE,
+) -> np.ndarray:
+    """Computes the percent cover of each endmember spectra from a local reflectance array.
+
+    Runs the same algorithm as fractionalCover() without earth engine. Each endmember
+        draw is unmixed with sum-to-one and non-negativity constraints, the fit is evaluated
+        with a forward model, and the estimates are averaged using RMSE-based weights.
+        Pixels are unmixed in blocks across a pool of threads. If a mask is passed,
+        only valid pixels are gathered into dense blocks and unmixed, so the run time
+        scales with the number of clear pixels rather than the array size. On the "gpu"
+        device, the operators for every draw stay on the device and blocks of
+        GPU_BLOCK_SIZE pixels are copied over, unmixed and copied back in turn.
+
+    Args:
+        array: reflectance data of shape (n_bands, ...), e.g. (n_bands, rows, cols).
+        endmembers: lists of endmember spectra, each element corresponding to a subType.
+            also accepts an array of shape (n_iterations, n_classes, n_bands).
+        shade_normalize: flag to apply shade normalization during unmixing.
+        mask: an optional boolean array of shape (...) that is True for pixels to unmix.
+            masked pixels are NaN in the output.
+        block_size: the number of pixels to unmix per block.
+        n_threads: the number of threads to unmix blocks with.
+        out: an optional float32 array of shape (n_classes + 1, ...) to write to.
+        device: the device to unmix on ("cpu" or "gpu", which requires cupy).
+            outputs are always returned in host memory.
+
+    Returns:
+        unmixed: an array of shape (n_classes + 1, ...) with the fractional cover of each
+            class (in the order of `endmembers`) followed by the RMSE.
+    """
+    validateDevice(device)
+    spectra = stackEndmembers(endmembers)
+    n_iterations, n_classes, n_bands = spectra.shape
+
+    array = asArray(array)
+    if array.shape[0] != n_bands:
+        raise ValueError(
+            f"Band mismatch: array has {array.shape[0]} bands, endmembers have {n_bands}"
+        )
+
+    spatial_shape = array.shape[1:]
+    pixels = array.reshape(n_bands, -1)
+    n_pixels = pixels.shape[1]
+
+    # write to the output buffer through a (n_classes + 1, n_pixels) view
+    out = outputArray(out, (n_classes + 1,) + spatial_shape, np.float32)
+    unmixed = out.reshape(n_classes + 1, n_pixels)
+    if not np.shares_memory(unmixed, out):
+        raise ValueError("Output arrays must be contiguous")
+
+    # compact the valid pixels into a list of indices to gather blocks from
+    if mask is None:
+        valid = None
+        n_valid = n_pixels
+    else:
+        mask = asArray(mask, dtype=bool)
+        if mask.shape != spatial_shape:
+            raise ValueError(
+                f"Mask shape mismatch: got {mask.shape}, expected {spatial_shape}"
+            )
+        valid = np.flatnonzero(mask)
+        n_valid = len(valid)
+        unmixed[:] = np.nan
+
+    # factorize each draw once and apply it to every block
+    operators = [drawOperators(draw, shade_normalize) for draw in spectra]
+    if device == "gpu":
+        operators = [
+            tuple(toDevice(operator, device) for operator in draw_operators)
+            for draw_operators in operators
+        ]
+        block_size = max(block_size, GPU_BLOCK_SIZE)
+        n_threads = 1
+
+    profiling.count("Unmix.pixels", n_pixels)
+    profiling.count("Unmix.masked", n_pixels - n_valid)
+    profiling.count("Unmix.solves", n_iterations * n_valid)
+
+    def unmixBlock(start: int) -> None:
+        stop = min(start + block_size, n_valid)
+        if valid is None:
+            indices = slice(start, stop)
+            block = pixels[:, indices]
+        else:
+            indices = valid[start:stop]
+            block = np.take(pixels, indices, axis=1)
+        with profiling.timer("Unmix.block"):
+            result = unmixPixels(
+                toDevice(block, device), operators, n_classes, shade_normalize
+            )
+            unmixed[:, indices] = asArray(result)
+
+    with ThreadPoolExecutor(max_workers=n_threads) as executor:
+        list(executor.map(unmixBlock, range(0, n_valid, block_size)))
+
+    return out
+
+
+def stackEndmembers(endmembers: list) -> np.ndarray:
+    """Converts per-class lists of endmember spectra into a single array.
+
+    Args:
+        endmembers: lists of endmember spectra, each element corresponding to a subType.
+            arrays of shape (n_iterations, n_classes, n_bands) are passed through.
+
+    Returns:
+        a float array of shape (n_iterations, n_classes, n_bands).
+    """
+    if isinstance(endmembers, np.ndarray):
+        return endmembers.astype(np.float64, copy=False)
+
+    return np.array(
+        [np.stack(spectra) for spectra in zip(*endmembers)], dtype=np.float64
+    )
+
+
+def unmixPixels(
+    pixels: np.ndarray,
+    operators: list,
+    n_classes: int,
+    shade_normalize: bool = True,
+) -> np.ndarray:
+    """Unmixes a block of pixels with each endmember draw and weights the estimates.
+
+    The RMSE weights are 1 - rmse_i / sum(rmse), so the weighted average reduces to
+        (sum(f_i) - sum(rmse_i * f_i) / sum(rmse)) / (n_iterations - 1). Each draw
+        only updates running sums, and no per-iteration estimates are stored. A
+        single draw is returned unweighted.
+
+    Args:
+        pixels: reflectance data of shape (n_bands, n_pixels). numpy or cupy arrays.
+        operators: the unmixing operators for each draw (from drawOperators()),
+            on the same device as `pixels`.
+        n_classes: the number of endmember classes, excluding shade.
+        shade_normalize: flag to apply shade normalization during unmixing.
+            the operators must have been built with the same setting.
+
+    Returns:
+        an array of shape (n_classes + 1, n_pixels) with the RMSE-weighted fractional
+            cover of each class followed by the weighted RMSE.
+    """
+    xp = arrayModule(pixels)
+    pixels = pixels.astype(np.float64)
+    n_iterations = len(operators)
+    n_pixels = pixels.shape[1]
+
+    # running sums of the fractions, rmse-scaled fractions, rmse and squared rmse
+    fraction_sum = xp.zeros((n_classes, n_pixels))
+    scaled_sum = xp.zeros((n_classes, n_pixels))
+    rmse_sum = xp.zeros(n_pixels)
+    rmse_squared_sum = xp.zeros(n_pixels)
+
+    with np.errstate(divide="ignore", invalid="ignore"):
+        for draw_operators in operators:
+
+            # the solver residual is the forward model fit
+            unmixed_iter, residual = fcls(pixels, draw_operators)
+            rmse = xp.sqrt(residual)
+
+            # normalize by the observed shade fraction
+            fractions = unmixed_iter[:n_classes]
+            if shade_normalize:
+                fractions /= xp.abs(unmixed_iter[n_classes] - 1)
+
+            fraction_sum += fractions
+            scaled_sum += fractions * rmse
+            rmse_sum += rmse
+            rmse_squared_sum += rmse**2
+
+        # a single draw has nothing to weight against
+        if n_iterations == 1:
+            return xp.vstack([fraction_sum, rmse_sum])
+
+        # use the sum of rmse to weight each estimate
+        weight_sum = n_iterations - 1
+        weighted = (fraction_sum - scaled_sum / rmse_sum) / weight_sum
+        weighted_rmse = (rmse_sum - rmse_squared_sum / rmse_sum) / weight_sum
+
+    return xp.vstack([weighted, weighted_rmse])
+
+
+def fcls(pixels: np.ndarray, operators: tuple) -> tuple:
+    """Fully constrained least squares unmixing (sum-to-one, non-negative fractions).
+
+    Evaluates the sum-to-one least squares solution for every subset of endmembers at
+        once and keeps the non-negative solution with the lowest residual. This is the
+        exact constrained optimum. The solve runs in endmember space after a single
+        E'y product, so every pixel does the same work regardless of which constraints
+        are active, and no per-pixel branching occurs.
+
+    Args:
+        pixels: reflectance data of shape (n_bands, n_pixels). numpy or cupy arrays.
+        operators: the operators for an endmember matrix (from unmixingOperators()).
+
+    Returns:
+        (fractions, residual): arrays of shape (n_endmembers, n_pixels) and (n_pixels,)
+            with the fractional abundances and the sum of squared model errors.
+    """
+    xp = arrayModule(pixels)
+    matrix, gram, projections, offsets = operators
+
+    # project the pixels into endmember space and solve every subset together
+    correlation = matrix.T @ pixels
+    solutions = xp.matmul(projections, correlation) + offsets[:, :, np.newaxis]
+
+    # expand ||y - Ex||^2 to avoid reconstructing the modeled spectra
+    residuals = (
+        (pixels**2).sum(axis=0)
+        - 2 * (solutions * correlation).sum(axis=1)
+        + (solutions * xp.matmul(gram, solutions)).sum(axis=1)
+    )
+    xp.maximum(residuals, 0, out=residuals)
+
+    # select the lowest-error non-negative solution for each pixel
+    feasible = (solutions >= -FCLS_TOLERANCE).all(axis=1)
+    residuals = xp.where(feasible, residuals, np.inf)
+    best = residuals.argmin(axis=0)[np.newaxis]
+    fractions = xp.take_along_axis(solutions, best[:, np.newaxis], axis=0)[0]
+    residual = xp.take_along_axis(residuals, best, axis=0)[0]
+    xp.maximum(fractions, 0, out=fractions)
+
+    # pixels with no valid fit (e.g. nodata) return nan, as the forward model would
+    residual[xp.isinf(residual)] = np.nan
+
+    return fractions, residual
+
+
+def drawOperators(spectra: np.ndarray, shade_normalize: bool = True) -> list:
+    """Gets the unmixing operators for a single endmember draw.
+
+    Args:
+        spectra: endmember array of shape (n_classes, n_bands).
+        shade_normalize: append a zero-reflectance shade endmember.
+
+    Returns:
+        the subset operators for the draw (see unmixingOperators()).
+    """
+    matrix = spectra.T
+    if shade_normalize:
+        matrix = np.hstack([matrix, np.zeros((matrix.shape[0], 1))])
+
+    return unmixingOperators(matrix)
+
+
+def unmixingOperators(matrix: np.ndarray) -> tuple:
+    """Factorizes an endmember matrix into sum-to-one least squares operators.
+
+    Each endmember subset S has a solution x = P E'y + c that is linear in the pixel
+        reflectance y. The projections P are zero-padded to the full endmember count
+        and stacked, so all subsets are solved with one batched matrix product.
+        Operators are cached by the contents of the endmember matrix, which identify
+        the (sensor, bands, endmember draw) combination, so repeated runs over a time
+        series reuse them instead of refactorizing.
+
+    Args:
+        matrix: endmember matrix of shape (n_bands, n_endmembers).
+
+    Returns:
+        (matrix, gram, projections, offsets): the endmember matrix, its gram matrix E'E
+            (n_endmembers, n_endmembers), the stacked subset projections
+            (n_subsets, n_endmembers, n_endmembers) and offsets (n_subsets, n_endmembers).
+    """
+    matrix = np.ascontiguousarray(matrix, dtype=np.float64)
+    key = (matrix.shape, hashlib.sha1(matrix.tobytes()).hexdigest())
+
+    with _operator_lock:
+        if key in _operator_cache:
+            _operator_cache.move_to_end(key)
+            profiling.count("Unmix.operator_cache.hits")
+            return _operator_cache[key]
+
+    profiling.count("Unmix.operator_cache.misses")
+
+    n_endmembers = matrix.shape[1]
+    gram = matrix.T @ matrix
+    subsets = endmemberSubsets(n_endmembers)
+    projections = np.zeros((len(subsets), n_endmembers, n_endmembers))
+    offsets = np.zeros((len(subsets), n_endmembers))
+    for i, subset in enumerate(subsets):
+        columns = list(subset)
+        projection, offset = sumToOneOperator(gram[np.ix_(columns, columns)])
+        projections[i][np.ix_(columns, columns)] = projection
+        offsets[i, columns] = offset
+
+    operators = (matrix, gram, projections, offsets)
+    with _operator_lock:
+        _operator_cache[key] = operators
+        while len(_operator_cache) > FACTORIZATION_CACHE_SIZE:
+            _operator_cache.popitem(last=False)
+
+    return operators
+
+
+def sumToOneOperator(gram: np.ndarray) -> tuple:
+    """Computes the least squares operator constrained to fractions that sum to one.
+
+    Args:
+        gram: the endmember gram matrix E'E of shape (n_endmembers, n_endmembers).
+
+    Returns:
+        (projection, offset): arrays of shape (n_endmembers, n_endmembers) and
+            (n_endmembers,) where the fractions for a pixel y are `projection @ E'y + offset`.
+    """
+    n_endmembers = gram.shape[0]
+
+    # invert the lagrangian system [[E'E, 1], [1', 0]] [x, l] = [E'y, 1]
+    kkt = np.ones((n_endmembers + 1, n_endmembers + 1))
+    kkt[:n_endmembers, :n_endmembers] = gram
+    kkt[n_endmembers, n_endmembers] = 0
+    inverse = np.linalg.pinv(kkt)
+    projection = inverse[:n_endmembers, :n_endmembers]
+    offset = inverse[:n_endmembers, n_endmembers]
+
+    return projection, offset
+
+
+def clearOperatorCache() -> None:
+    """Removes all cached endmember factorizations."""
+    with _operator_lock:
+        _operator_cache.clear()
+
+
+def endmemberSubsets(n_endmembers: int) -> list:
+    """Lists every non-empty combination of endmember indices.
+
+    Args:
+        n_endmembers: the number of endmembers.
+
+    Returns:
+        a list of tuples of endmember indices.
+    """
+    return [
+        subset
+        for size in range(1, n_endmembers + 1)
+        for subset in itertools.combinations(range(n_endmembers), size)
+    ]
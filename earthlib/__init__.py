@@ -3,6 +3,7 @@ from earthlib import (
     BrightMask,
     BurnPVSoil,
     CloudMask,
+    Composite,
     NIRv,
     Scale,
     ShadeMask,
@@ -11,17 +12,35 @@ from earthlib import (
     Unmix,
     VegImperviousSoil,
     __version__,
+    buffers,
+    pipeline,
+    profiling,
     read,
+    search,
+    tiles,
 )
-from earthlib.config import collections, metadata
+from earthlib.config import collections, getMetadata
 from earthlib.utils import (
     getBands,
     getCollection,
     getScaler,
     listSensors,
     listTypes,
+    sampleEndmembers,
     selectSpectra,
 )
 
-# expose the full spectral library
-library = read.endmembers()
+# the full spectral library and its metadata are read on first access
+_library = None
+
+
+def __getattr__(name: str):
+    """Lazily expose the spectral `library` and its `metadata`"""
+    global _library
+    if name == "library":
+        if _library is None:
+            _library = read.endmembers()
+        return _library
+    elif name == "metadata":
+        return getMetadata()
+    raise AttributeError(f"module {__name__!r} has no attribute {name!r}")
@@ -0,0 +1,163 @@
+"""Zero-copy conversion of array buffers passed to and returned from local kernels."""
+
+from types import ModuleType
+
+import numpy as np
+
+
+def asArray(data, dtype: np.dtype = None) -> np.ndarray:
+    """Returns a numpy view of an array-like object, copying only to convert types.
+
+    Accepts numpy arrays, objects exposing the buffer protocol or the numpy array
+        interface (e.g. memoryviews, dask chunks), and pyarrow Arrays, ChunkedArrays and
+        Tensors. Numeric data without nulls is shared with the source, not copied.
+
+    Args:
+        data: the array-like object.
+        dtype: the data type to return. data are copied if the type differs.
+
+    Returns:
+        a numpy array.
+    """
+    module = type(data).__module__.split(".")[0]
+    if module == "pyarrow":
+        try:
+            data = data.to_numpy()
+        except (TypeError, ValueError):
+            data = data.to_numpy(zero_copy_only=False)
+    elif module == "cupy":
+        data = data.get()
+
+    return np.asarray(data, dtype=dtype)
+
+
+def asArrays(bands, shape: tuple = None) -> dict:
+    """Converts a set of named bands to numpy views.
+
+    Args:
+        bands: a dictionary of {band name: array-like}, or a pyarrow Table or
+            RecordBatch with one column per band.
+        shape: the (rows, cols) shape of each band, used to reshape flat columns.
+
+    Returns:
+        a dictionary of {band name: numpy array}.
+    """
+    if hasattr(bands, "column_names"):
+        bands = {name: bands.column(name) for name in bands.column_names}
+
+    arrays = dict()
+    for name, band in bands.items():
+        array = asArray(band)
+        arrays[name] = array if shape is None else array.reshape(shape)
+
+    return arrays
+
+
+def outputArray(out: np.ndarray, shape: tuple, dtype: np.dtype) -> np.ndarray:
+    """Returns a caller-provided output buffer after checking it, or allocates one.
+
+    Args:
+        out: the output buffer, or None to allocate a new array.
+        shape: the expected output shape.
+        dtype: the expected output type.
+
+    Returns:
+        an array of `shape` and `dtype`.
+
+    Raises:
+        ValueError: when the output buffer has the wrong shape or type.
+    """
+    if out is None:
+        return np.empty(shape, dtype=dtype)
+
+    out = asArray(out)
+    if out.shape != tuple(shape) or out.dtype != np.dtype(dtype):
+        raise ValueError(
+            f"Output mismatch: got {out.shape} {out.dtype}, expected {tuple(shape)} "
+            f"{np.dtype(dtype)}"
+        )
+    return out
+
+
+def toArrow(array: np.ndarray):
+    """Wraps a numpy array as a pyarrow object without copying.
+
+    Requires pyarrow (`pip install earthlib[arrow]`).
+
+    Args:
+        array: a numeric numpy array.
+
+    Returns:
+        a pyarrow Array for 1d arrays, a pyarrow Tensor otherwise.
+    """
+    import pyarrow as pa
+
+    if array.ndim == 1:
+        return pa.array(array)
+    return pa.Tensor.from_numpy(array)
+
+
+def toArrowTable(bands: dict):
+    """Wraps named 2d arrays as a pyarrow Table with one flattened column per band.
+
+    Contiguous arrays are shared with the table, not copied, so the results of a local
+        kernel can be handed to Arrow-based tools (e.g. Ray, Dask, DuckDB) directly.
+
+    Args:
+        bands: a dictionary of {band name: numeric array}.
+
+    Returns:
+        a pyarrow Table. use asArrays(table, shape) to get the 2d arrays back.
+    """
+    import pyarrow as pa
+
+    return pa.table({name: pa.array(np.ravel(band)) for name, band in bands.items()})
+
+
+def getArrayModule(device: str = "cpu") -> ModuleType:
+    """Gets the array library used to compute on a device.
+
+    Args:
+        device: "cpu" for numpy or "gpu" for cupy (`pip install cupy-cuda12x`, or the
+            cupy build matching the local CUDA/ROCm version).
+
+    Returns:
+        the numpy or cupy module.
+    """
+    if device == "gpu":
+        import cupy
+
+        return cupy
+    return np
+
+
+def arrayModule(array) -> ModuleType:
+    """Gets the array library (numpy or cupy) an array belongs to.
+
+    Args:
+        array: a numpy or cupy array.
+
+    Returns:
+        the numpy or cupy module.
+    """
+    if type(array).__module__.split(".")[0] == "cupy":
+        import cupy
+
+        return cupy
+    return np
+
+
+def toDevice(array, device: str = "cpu", dtype: np.dtype = None):
+    """Copies an array to a device, or returns it as-is if it's already there.
+
+    Args:
+        array: an array-like object.
+        device: the device to copy to ("cpu" or "gpu").
+        dtype: the data type to return.
+
+    Returns:
+        a numpy or cupy array.
+    """
+    if device == "gpu":
+        return getArrayModule(device).asarray(array, dtype=dtype)
+    return asArray(array, dtype=dtype)
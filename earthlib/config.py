@@ -1,9 +1,9 @@
 """Default configuration paths and parameters"""
 
+import csv
 import json
 import os
-
-import pandas as pd
+import threading
 
 # file paths for the package data
 package_path = os.path.realpath(__file__)
@@ -12,11 +12,56 @@ collections_path = os.path.join(package_dir, "data", "collections.json")
 metadata_path = os.path.join(package_dir, "data", "spectra-optimized.csv")
 endmember_path = os.path.join(package_dir, "data", "spectra-optimized.sli")
 
-# read critical data into memory
-metadata = pd.read_csv(metadata_path)
-with open(collections_path, "r+") as f:
+# read critical data into memory. the endmember metadata is only read on first use
+with open(collections_path, "r") as f:
     collections = json.load(f)
 
+_metadata = None
+_type_index = None
+_metadata_lock = threading.Lock()
+
+
+def getMetadata():
+    """Reads the endmember library metadata into a pandas DataFrame on first use.
+
+    Returns:
+        the per-spectrum class labels (LEVEL_1..LEVEL_4) and sources.
+    """
+    global _metadata
+    with _metadata_lock:
+        if _metadata is None:
+            import pandas as pd
+
+            _metadata = pd.read_csv(metadata_path)
+        return _metadata
+
+
+def getTypeIndex() -> dict:
+    """Reads the unique spectral types per classification level on first use.
+
+    Parses the metadata .csv directly so type lookups don't require pandas.
+
+    Returns:
+        a dictionary of {level: {type: None}} with types in order of appearance.
+    """
+    global _type_index
+    with _metadata_lock:
+        if _type_index is None:
+            index = {level: dict() for level in range(1, 5)}
+            with open(metadata_path, "r", newline="") as f:
+                for row in csv.DictReader(f):
+                    for level, types in index.items():
+                        types.setdefault(row[f"LEVEL_{level}"], None)
+            _type_index = index
+        return _type_index
+
+
+def __getattr__(name: str):
+    """Loads `metadata` lazily so importing earthlib doesn't import pandas"""
+    if name == "metadata":
+        return getMetadata()
+    raise AttributeError(f"module {__name__!r} has no attribute {name!r}")
+
 
 # BRDF correction coefficients
 # https://www.sciencedirect.com/science/article/pii/S0034425716300220
@@ -53,8 +98,199 @@ BRDF_COEFFICIENTS_S2 = {
     "B12": {"fiso": 0.2658, "fgeo": 0.0387, "fvol": 0.0639},
 }
 
+# QA decoding rules for cloud masking: (band, fromBit, toBit, comparison, value)
+# a pixel is valid when every rule evaluates to True
+QA_RULES = {
+    "Landsat4578": [
+        ("QA_PIXEL", 1, 1, "eq", 0),  # dilated cloud
+        ("QA_PIXEL", 2, 2, "eq", 0),  # cirrus
+        ("QA_PIXEL", 3, 3, "eq", 0),  # cloud
+        ("QA_PIXEL", 4, 4, "eq", 0),  # cloud shadow
+        ("QA_PIXEL", 5, 5, "eq", 0),  # snow
+        ("QA_RADSAT", 0, 15, "eq", 0),  # radiometric saturation
+    ],
+    "Sentinel2QA": [
+        ("QA60", 10, 10, "eq", 0),  # opaque clouds
+        ("QA60", 11, 11, "eq", 0),  # cirrus
+    ],
+    "Sentinel2SCL": [
+        ("SCL", 0, 7, "neq", 1),  # saturated or defective
+        ("SCL", 0, 7, "neq", 3),  # cloud shadows
+        ("SCL", 0, 7, "neq", 7),  # clouds low probability
+        ("SCL", 0, 7, "neq", 8),  # clouds medium probability
+        ("SCL", 0, 7, "neq", 9),  # clouds high probability
+        ("SCL", 0, 7, "neq", 10),  # cirrus
+    ],
+    "MODIS": [
+        ("state_1km", 0, 1, "eq", 0),  # cloud state
+        ("state_1km", 2, 2, "eq", 0),  # cloud shadow
+        ("state_1km", 6, 7, "lte", 1),  # aerosol quantity
+        ("state_1km", 8, 9, "eq", 0),  # cirrus
+        ("state_1km", 10, 10, "eq", 0),  # internal cloud
+        ("state_1km", 11, 11, "eq", 0),  # fire
+        ("state_1km", 15, 15, "eq", 0),  # internal snow
+    ],
+    "VIIRS": [
+        ("QF1", 2, 3, "eq", 0),  # cloud mask confidence
+        ("QF1", 4, 4, "eq", 0),  # day/night
+        ("QF2", 3, 3, "eq", 0),  # cloud shadow
+        ("QF2", 5, 5, "eq", 0),  # snow/ice
+        ("QF2", 6, 6, "eq", 0),  # cirrus (reflective)
+        ("QF2", 7, 7, "eq", 0),  # cirrus (emissive)
+        ("QF7", 1, 1, "eq", 0),  # adjacent to cloud
+        ("QF7", 4, 4, "eq", 0),  # thin cirrus
+    ],
+}
+QA_RULES["Sentinel2"] = QA_RULES["Sentinel2QA"] + QA_RULES["Sentinel2SCL"]
+
+# cloud probability threshold tests from Sun & Tian 2017
+# https://www.sciencedirect.com/science/article/pii/S0924271616306189
+# each test is a list of (band, comparison, value) conditions that must all be True,
+# where "A/B" bands are band ratios. the cloud probability is the fraction of passing tests
+THRESHOLD_TESTS = {
+    "Landsat457": {
+        "probability_threshold": 0.4,
+        "tests": [
+            [("SR_B1", "gt", 0.2)],
+            [("SR_B2", "gt", 0.2)],
+            [("SR_B3", "gt", 0.21)],
+            [("SR_B5", "gt", 0.29)],
+            [("SR_B7", "gt", 0.25)],
+            [("SR_B1", "gt", 0.16), ("SR_B4", "gt", 0.26)],
+            [("SR_B1", "gt", 0.20), ("SR_B5", "gt", 0.20)],
+            [("SR_B2", "gt", 0.12), ("SR_B4", "gt", 0.32)],
+            [("SR_B3", "gt", 0.14), ("SR_B4", "gt", 0.35)],
+            [("SR_B4", "gt", 0.40), ("SR_B5", "gt", 0.30)],
+            [("SR_B5/SR_B7", "gt", 0.91), ("SR_B5/SR_B7", "lt", 1.83)],
+        ],
+    },
+    "Landsat8": {
+        "probability_threshold": 0.4,
+        "tests": [
+            [("SR_B2", "gt", 0.2)],
+            [("SR_B3", "gt", 0.2)],
+            [("SR_B4", "gt", 0.21)],
+            [("SR_B6", "gt", 0.29)],
+            [("SR_B7", "gt", 0.25)],
+            [("SR_B1", "gt", 0.24), ("SR_B5", "gt", 0.26)],
+            [("SR_B1", "gt", 0.24), ("SR_B6", "gt", 0.20)],
+            [("SR_B2", "gt", 0.16), ("SR_B5", "gt", 0.26)],
+            [("SR_B2", "gt", 0.20), ("SR_B6", "gt", 0.20)],
+            [("SR_B3", "gt", 0.12), ("SR_B5", "gt", 0.32)],
+            [("SR_B4", "gt", 0.14), ("SR_B5", "gt", 0.35)],
+            [("SR_B5", "gt", 0.40), ("SR_B6", "gt", 0.30)],
+            [("SR_B6/SR_B7", "gt", 0.91), ("SR_B6/SR_B7", "lt", 1.83)],
+        ],
+    },
+    "MODIS": {
+        "probability_threshold": 0.6,
+        "tests": [
+            [("sur_refl_b01", "gt", 0.29)],
+            [("sur_refl_b03", "gt", 0.23)],
+            [("sur_refl_b04", "gt", 0.24)],
+            [("sur_refl_b01", "gt", 0.28), ("sur_refl_b05", "gt", 0.24)],
+            [("sur_refl_b01", "gt", 0.28), ("sur_refl_b06", "gt", 0.16)],
+            [("sur_refl_b03", "gt", 0.28), ("sur_refl_b07", "gt", 0.08)],
+            [
+                ("sur_refl_b02/sur_refl_b01", "gt", 0.95),
+                ("sur_refl_b02/sur_refl_b01", "lt", 1.15),
+            ],
+        ],
+    },
+    "VIIRS": {
+        "probability_threshold": 0.4,
+        "tests": [
+            [("M1", "gt", 0.31)],
+            [("M2", "gt", 0.25)],
+            [("M3", "gt", 0.25)],
+            [("M4", "gt", 0.25)],
+            [("M5", "gt", 0.30)],
+            [("M7", "gt", 0.52)],
+            [("M8", "gt", 0.46)],
+            [("M1", "gt", 0.29), ("M7", "gt", 0.30)],
+            [("M1", "gt", 0.29), ("M8", "gt", 0.22)],
+            [("M1", "gt", 0.31), ("M10", "gt", 0.08)],
+            [("M1", "gt", 0.29), ("M11", "gt", 0.12)],
+            [("M2", "gt", 0.27), ("M8", "gt", 0.22)],
+            [("M2", "gt", 0.72), ("M10", "gt", 0.14)],
+            [("M3", "gt", 0.23), ("M8", "gt", 0.24)],
+            [("M3", "gt", 0.16), ("M9", "gt", 0.08)],
+            [("M6/M4", "gt", 0.12), ("M6/M4", "lt", 0.48)],
+            [("M7/M5", "gt", 1.0), ("M7/M5", "lt", 1.15)],
+        ],
+    },
+}
+
+# spectral index expressions, using the band roles from SPECTRAL_INDEX_ROLES
+SPECTRAL_INDICES = {
+    "NIRv": "((nir - red) / (nir + red) - 0.08) * nir",
+    "NDVI": "(nir - red) / (nir + red)",
+    "NBR": "(nir - swir2) / (nir + swir2)",
+    "NDWI": "(green - nir) / (green + nir)",
+    "EVI": "2.5 * (nir - red) / (nir + 6 * red - 7.5 * blue + 1)",
+}
+
+# variable names for each band description in collections.json
+SPECTRAL_INDEX_ROLES = {
+    "blue": "blue",
+    "green": "green",
+    "red": "red",
+    "near infrared": "nir",
+    "shortwave infrared 1": "swir1",
+    "shortwave infrared 2": "swir2",
+}
+
+# target wavelengths (um) for each role, used to pick between bands sharing a role
+SPECTRAL_INDEX_WAVELENGTHS = {
+    "blue": 0.48,
+    "green": 0.56,
+    "red": 0.655,
+    "nir": 0.865,
+    "swir1": 1.61,
+    "swir2": 2.2,
+}
+
 # spectral mixture analysis defaults
 N_ITERATIONS = 30
 SHADE_NORMALIZE = True
 RMSE = "RMSE"
 WEIGHT = "WEIGHT"
+
+# endmember sampling seed. None draws a seed from numpy's global random state
+RANDOM_SEED = None
+
+# local processing defaults
+BACKEND = "ee"
+BACKENDS = ["ee", "local"]
+BLOCK_SIZE = 16384
+DEVICE = "cpu"
+DEVICES = ["cpu", "gpu"]
+GPU_BLOCK_SIZE = 262144
+N_THREADS = os.cpu_count() or 1
+FCLS_TOLERANCE = 1e-9
+FACTORIZATION_CACHE_SIZE = 4096
+LIBRARY_CACHE_SIZE = 8
+SRF_N_SIGMA = 3
+ROW_BLOCK_SIZE = 1024
+TILE_ROWS = 256
+TILES_IN_FLIGHT = 2 * N_THREADS
+COMPOSITE_BINS = 64
+COMPOSITE_RANGE = (0, 1)
+BRDF_GRID_STEP = 32
+BRDF_CACHE_SIZE = 64
+REFLECTANCE_SCALE = 10000
+INT16_NODATA = -32768
+
+# spectral library search and pruning defaults
+SEARCH_METRIC = "angle"
+SEARCH_METRICS = ["angle", "euclidean"]
+SEARCH_BLOCK_SIZE = 2**24
+IVF_MIN_SPECTRA = 100000
+IVF_N_PROBE = 8
+IVF_ITERATIONS = 20
+DEDUPE_ANGLE = 0.01
+DEDUPE_NEIGHBORS = 32
+
+# profiling defaults. timers and counters are no-ops until profiling.enable() is called
+PROFILE = False
+PROFILE_MAX_EVENTS = 100000
@@ -11,3 +11,9 @@ class EndmemberError(KeyError):
     """Raised when a function calls for an invalid land cover type"""
 
     pass
+
+
+class BackendError(KeyError):
+    """Raised when an unsupported processing backend is requested"""
+
+    pass
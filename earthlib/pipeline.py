@@ -0,0 +1,471 @@
+"""Composable per-sensor preprocessing pipelines for earth engine and local data."""
+
+from types import ModuleType
+from typing import Callable
+
+import ee
+import numpy as np
+
+from earthlib import BRDFCorrect, CloudMask, NIRv, Scale, profiling
+from earthlib.buffers import asArrays, outputArray
+from earthlib.config import (
+    BACKEND,
+    DEVICE,
+    INT16_NODATA,
+    N_ITERATIONS,
+    N_THREADS,
+    RMSE,
+    SHADE_NORMALIZE,
+    TILE_ROWS,
+    TILES_IN_FLIGHT,
+)
+from earthlib.tiles import (
+    TileScheduler,
+    bandDescriptions,
+    processRaster,
+    stripWindows,
+    windowSlices,
+)
+from earthlib.Unmix import fractionalCover, fractionalCoverLocal
+from earthlib.utils import getBands, validateBackend, validateDevice, validateSensor
+
+# stages always run in this order, regardless of the order they are passed in.
+# masking and BRDF correction operate on the raw QA and surface reflectance values,
+# so they run before scaling on earth engine. local pipelines scale the reflectance
+# bands before BRDF correction, so the c-factor isn't applied to the scale offset.
+STAGES = ["cloudmask", "brdf", "scale", "nirv", "unmix"]
+
+
+class Pipeline:
+    """Class for running a sequence of preprocessing stages for a sensor
+
+    Attributes:
+        sensor: the name of the sensor (from earthlib.listSensors())
+        stages: the stages to run, in execution order (from earthlib.pipeline.STAGES)
+        backend: the processing backend ("ee" or "local")
+        bands: the reflectance bands to process
+        unmixer: the unmixing module (e.g. earthlib.SoilPVNPV) for the "unmix" stage
+        n: the number of iterations for unmixing
+        shade_normalize: apply shade normalization during unmixing
+        scaleFactor: the BRDF volumetric scattering scaling factor
+        dtype: the local reflectance type after scaling (see Scale.scaleLocal())
+        device: the device to run the local BRDF and unmixing kernels on
+    """
+
+    sensor: str
+    stages: list
+    backend: str
+    bands: list
+    unmixer: ModuleType
+    n: int
+    shade_normalize: bool
+    scaleFactor: float
+    dtype: np.dtype
+    device: str
+
+    def __init__(
+        self,
+        sensor: str,
+        stages: list = None,
+        backend: str = BACKEND,
+        unmixer: ModuleType = None,
+        n: int = N_ITERATIONS,
+        shade_normalize: bool = SHADE_NORMALIZE,
+        scaleFactor: float = 1,
+        dtype: np.dtype = np.float32,
+        device: str = DEVICE,
+    ):
+        """Set up a preprocessing pipeline.
+
+        Args:
+            sensor: the name of the sensor (from earthlib.listSensors()).
+            stages: the stages to run (from earthlib.pipeline.STAGES). defaults to all
+                stages, with "unmix" only included if `unmixer` is set.
+            backend: the processing backend. "local" runs the stages on numpy arrays.
+            unmixer: the unmixing module to use (e.g. earthlib.SoilPVNPV).
+            n: the number of iterations for unmixing.
+            shade_normalize: apply shade normalization during unmixing.
+            scaleFactor: a scaling factor to tune the BRDF volumetric scattering adjustment.
+            dtype: the local reflectance type after scaling. float16 or int16 (scaled by
+                REFLECTANCE_SCALE) halve memory traffic; values are only converted to
+                float32 for the NIRv and unmixing math.
+            device: the device to run the local BRDF and unmixing kernels on. "gpu"
+                requires cupy.
+        """
+        validateSensor(sensor)
+        validateBackend(backend)
+        validateDevice(device)
+
+        if stages is None:
+            stages = [stage for stage in STAGES if stage != "unmix" or unmixer]
+        for stage in stages:
+            if stage not in STAGES:
+                raise ValueError(f"Invalid stage: {stage}. Supported: {STAGES}")
+        if "unmix" in stages and unmixer is None:
+            raise ValueError("An unmixer module must be passed to run the unmix stage")
+
+        self.sensor = sensor
+        self.stages = sorted(set(stages), key=STAGES.index)
+        self.backend = backend
+        self.bands = getBands(sensor)
+        self.unmixer = unmixer
+        self.n = n
+        self.shade_normalize = shade_normalize
+        self.scaleFactor = scaleFactor
+        self.dtype = np.dtype(dtype)
+        self.device = device
+        self._endmembers = None
+
+    def __call__(self, data, **kwargs):
+        """Runs the pipeline on an ee.Image or a dictionary of local arrays.
+
+        Args:
+            data: an ee.Image ("ee" backend) or a dictionary of bands ("local" backend).
+            **kwargs: keyword arguments passed to run() for the "local" backend.
+
+        Returns:
+            the processed ee.Image or dictionary of output arrays.
+        """
+        if self.backend == "local":
+            return self.run(data, **kwargs)
+
+        return self.function()(data)
+
+    def endmembers(self) -> tuple:
+        """Get the endmembers for the unmix stage, sampled once per pipeline.
+
+        Returns:
+            per-class endmember lists (ee.List objects or numpy arrays by backend).
+        """
+        if self._endmembers is None:
+            self._endmembers = self.unmixer.getEndmembers(
+                self.sensor, self.bands, self.n, backend=self.backend
+            )
+        return self._endmembers
+
+    def outputNames(self) -> list:
+        """Get the names of the bands produced by the final stage.
+
+        Returns:
+            list of output band names.
+        """
+        if "unmix" in self.stages:
+            names = self.unmixer.ENDMEMBER_NAMES + [RMSE]
+            return names + ["NIRv"] if "nirv" in self.stages else names
+        elif "nirv" in self.stages:
+            return ["NIRv"]
+        else:
+            return list(self.bands)
+
+    def function(self) -> Callable:
+        """Composes the earth engine stages into a single function.
+
+        Returns:
+            a function to pass to an ee.ImageCollection .map() call.
+        """
+        functions = list()
+        if "cloudmask" in self.stages:
+            functions.append(CloudMask.bySensor(self.sensor))
+
+        if "brdf" in self.stages:
+            correct = BRDFCorrect.bySensor(self.sensor)
+            scaleFactor = self.scaleFactor
+            functions.append(lambda image: correct(image, scaleFactor))
+
+        if "scale" in self.stages:
+            functions.append(Scale.bySensor(self.sensor))
+
+        if "nirv" in self.stages:
+            functions.append(NIRv.bySensor(self.sensor))
+
+        if "unmix" in self.stages:
+            endmembers = self.endmembers()
+            names = self.unmixer.ENDMEMBER_NAMES
+            bands = self.bands
+            shade_normalize = self.shade_normalize
+            keepNIRv = "nirv" in self.stages
+
+            def unmix(image):
+                unmixed = fractionalCover(
+                    image.select(bands),
+                    endmembers,
+                    endmember_names=names,
+                    n_bands=len(bands),
+                    shade_normalize=shade_normalize,
+                )
+                return unmixed.addBands(image.select("NIRv")) if keepNIRv else unmixed
+
+            functions.append(unmix)
+
+        def composed(image: ee.Image) -> ee.Image:
+            for function in functions:
+                image = function(image)
+            return image
+
+        return profiling.instrument(composed, f"pipeline.{self.sensor}")
+
+    @profiling.timed("pipeline.run")
+    def run(
+        self,
+        bands: dict,
+        geometry: dict = None,
+        outputs: list = None,
+        block_rows: int = TILE_ROWS,
+        n_threads: int = N_THREADS,
+        max_in_flight: int = TILES_IN_FLIGHT,
+        out: dict = None,
+    ) -> dict:
+        """Runs the stages on local arrays one row tile at a time.
+
+        Every stage runs on a tile before the next tile is read, so intermediate
+            products (e.g. scaled reflectance) are only ever tile-sized. Pixels
+            masked by the cloud mask are not unmixed and are set to NaN in the outputs.
+
+        Args:
+            bands: a dictionary of {band name: (rows, cols) array}, with the sensor
+                reflectance bands and any QA bands used for cloud masking. any
+                array-like buffer is accepted (see buffers.asArrays()).
+            geometry: keyword arguments for BRDFCorrect.kernelGrids() with "lon", "lat",
+                "time_start" and "corners" keys. required for the "brdf" stage.
+            outputs: the names of the outputs to return. defaults to the outputs of the
+                final stage (and the "mask" if cloud masking).
+            block_rows: the number of rows to process per tile.
+            n_threads: the number of tiles to process concurrently.
+            max_in_flight: the maximum number of tiles held in memory at once.
+            out: an optional dictionary of {output name: full-size array} to write
+                outputs to, e.g. views into a shared or memory-mapped stack.
+
+        Returns:
+            a dictionary of {output name: full-size array}.
+        """
+        bands = asArrays(bands)
+        shape = bands[self.bands[0]].shape
+        outputs = self.defaultOutputs(outputs)
+        processTile = self.tileFunction(shape, geometry, outputs)
+
+        out = out or dict()
+        results = dict()
+        for name, dtype in self.outputDtypes(outputs).items():
+            results[name] = outputArray(out.get(name), shape, dtype)
+
+        def runTile(window):
+            rows, _ = windowSlices(window)
+            tile = {name: band[rows] for name, band in bands.items()}
+            return processTile(tile, window)
+
+        def writeTile(window, products):
+            rows, _ = windowSlices(window)
+            for name in outputs:
+                results[name][rows] = products[name]
+
+        scheduler = TileScheduler(n_threads, max_in_flight)
+        scheduler.run(runTile, writeTile, stripWindows(shape, block_rows))
+
+        return results
+
+    @profiling.timed("pipeline.runRaster")
+    def runRaster(
+        self,
+        input_path: str,
+        output_path: str,
+        band_names: list = None,
+        geometry: dict = None,
+        outputs: list = None,
+        block_rows: int = TILE_ROWS,
+        n_threads: int = N_THREADS,
+        max_in_flight: int = TILES_IN_FLIGHT,
+        **profile,
+    ) -> dict:
+        """Runs the stages on a raster on disk, writing the outputs to a new raster.
+
+        Requires rasterio (`pip install earthlib[raster]`).
+
+        Args:
+            input_path: file path to a GeoTIFF or COG with the sensor bands.
+            output_path: file path to write the output GeoTIFF to, one band per output.
+                reduced-precision reflectance and float products (e.g. NIRv) are
+                written to separate rasters (see tiles.rasterPaths()).
+            band_names: the names of the input bands. defaults to the band
+                descriptions, or the sensor bands if the raster has one unnamed band
+                per sensor band.
+            geometry: keyword arguments for BRDFCorrect.kernelGrids(). see run().
+            outputs: the names of the outputs to write. see run().
+            block_rows: the number of rows to process per tile.
+            n_threads: the number of tiles to process concurrently.
+            max_in_flight: the maximum number of tiles held in memory at once.
+            **profile: creation options for the output raster (e.g. compress="deflate").
+
+        Returns:
+            a dictionary of {file path: output names written to it}.
+        """
+        import rasterio
+
+        with rasterio.open(input_path) as src:
+            shape = (src.height, src.width)
+            n_bands = src.count
+
+        # unnamed rasters holding just the sensor bands are read in getBands() order
+        unnamed = band_names is None and bandDescriptions(input_path) is None
+        if unnamed and n_bands == len(self.bands):
+            band_names = list(self.bands)
+
+        # GeoTIFFs don't support float16
+        outputs = self.defaultOutputs(outputs)
+        dtypes = {
+            name: np.float32 if dtype == np.float16 else dtype
+            for name, dtype in self.outputDtypes(outputs).items()
+        }
+        return processRaster(
+            input_path,
+            output_path,
+            self.tileFunction(shape, geometry, outputs),
+            outputs,
+            band_names=band_names,
+            windows=stripWindows(shape, block_rows),
+            dtype=dtypes,
+            n_threads=n_threads,
+            max_in_flight=max_in_flight,
+            **profile,
+        )
+
+    def defaultOutputs(self, outputs: list = None) -> list:
+        """Get the outputs to return from a local run.
+
+        Args:
+            outputs: the requested outputs. returned as-is if set.
+
+        Returns:
+            the outputs of the final stage (and the "mask" if cloud masking).
+        """
+        if outputs is not None:
+            return outputs
+
+        outputs = self.outputNames()
+        if "cloudmask" in self.stages:
+            outputs = outputs + ["mask"]
+        return outputs
+
+    def outputDtypes(self, outputs: list) -> dict:
+        """Get the data type of each local output.
+
+        Args:
+            outputs: the names of the outputs.
+
+        Returns:
+            a dictionary of {output name: data type}. only scaled reflectance bands use
+                the reduced-precision `dtype`; derived products are float32.
+        """
+        dtypes = dict()
+        for name in outputs:
+            if name == "mask":
+                dtypes[name] = np.dtype(bool)
+            elif name in self.bands and "scale" in self.stages:
+                dtypes[name] = self.dtype
+            else:
+                dtypes[name] = np.dtype(np.float32)
+        return dtypes
+
+    def tileFunction(self, shape: tuple, geometry: dict, outputs: list) -> Callable:
+        """Sets up everything shared by all tiles and returns a per-tile function.
+
+        Args:
+            shape: the (rows, cols) shape of the full scene.
+            geometry: keyword arguments for BRDFCorrect.kernelGrids(). see run().
+            outputs: the names of the outputs to return for each tile.
+
+        Returns:
+            a function that takes ({band name: array}, window) for a full-width
+                row strip and returns a dictionary of {output name: array}.
+        """
+        if "brdf" in self.stages:
+            if geometry is None:
+                raise ValueError("Scene geometry must be passed to run the brdf stage")
+            kernels = BRDFCorrect.kernelGrids(shape=shape, **geometry)
+            coefficients = BRDFCorrect.getCoefficients(self.sensor)
+        scale, offset = Scale.getScaleParams(self.sensor)
+        red, nir = NIRv.getNIRvBands(self.sensor)
+        if "unmix" in self.stages:
+            endmembers = self.endmembers()
+            names = self.unmixer.ENDMEMBER_NAMES + [RMSE]
+
+        def processTile(tile, window):
+            start = window[0]
+            tile_shape = tile[self.bands[0]].shape
+            products = dict()
+
+            mask = None
+            if "cloudmask" in self.stages:
+                with profiling.timer("pipeline.cloudmask"):
+                    mask = CloudMask.qaMaskLocal(
+                        tile, self.sensor, pack=False, n_threads=1
+                    )
+                products["mask"] = mask
+
+            # convert reduced-precision reflectance only for the stages doing float math
+            def asFloat(band):
+                if "scale" in self.stages:
+                    return Scale.toReflectance(band)
+                return np.asarray(band, dtype=np.float32)
+
+            # raw DNs are scaled first, so the c-factor isn't applied to the offset
+            reflectance = {name: tile[name] for name in self.bands}
+            if "scale" in self.stages:
+                with profiling.timer("pipeline.scale"):
+                    for name, band in reflectance.items():
+                        reflectance[name] = Scale.scaleLocal(
+                            band, scale, offset, dtype=self.dtype
+                        )
+
+            if "brdf" in self.stages:
+                with profiling.timer("pipeline.brdf"):
+                    corrected = BRDFCorrect.correctRows(
+                        {name: asFloat(band) for name, band in reflectance.items()},
+                        kernels,
+                        coefficients,
+                        self.scaleFactor,
+                        start,
+                        self.device,
+                    )
+                if "scale" in self.stages and self.dtype != np.float32:
+                    for name, band in corrected.items():
+                        corrected[name] = Scale.scaleLocal(band, dtype=self.dtype)
+                reflectance.update(corrected)
+            products.update(reflectance)
+
+            if "nirv" in self.stages:
+                with profiling.timer("pipeline.nirv"):
+                    products["NIRv"] = NIRv.NIRvLocal(
+                        asFloat(reflectance[red]), asFloat(reflectance[nir])
+                    )
+
+            if "unmix" in self.stages:
+                with profiling.timer("pipeline.unmix"):
+                    stack = np.empty((len(self.bands),) + tile_shape, dtype=np.float32)
+                    for i, name in enumerate(self.bands):
+                        stack[i] = asFloat(reflectance[name])
+
+                    # nodata reflectance is NaN, and skipped like cloud-masked pixels
+                    valid = np.isfinite(stack).all(axis=0)
+                    if mask is not None:
+                        valid &= mask
+                    unmixed = fractionalCoverLocal(
+                        stack,
+                        endmembers,
+                        shade_normalize=self.shade_normalize,
+                        mask=valid,
+                        n_threads=1,
+                        device=self.device,
+                    )
+                products.update(zip(names, unmixed))
+
+            masked = dict()
+            for name in outputs:
+                product = products[name]
+                if mask is not None and name != "mask":
+                    nodata = INT16_NODATA if product.dtype == np.int16 else np.nan
+                    product = np.where(mask, product, nodata)
+                masked[name] = product
+
+            return masked
+
+        return processTile
@@ -0,0 +1,299 @@
+"""Lightweight timers and counters for profiling earthlib processing stages.
+
+Profiling is off by default. Until it is enabled, every timer and counter call returns
+    immediately, so instrumented code runs at full speed:
+
+    from earthlib import profiling
+    profiling.enable()
+    results = pipeline.run(bands)
+    print(profiling.prometheus())
+    profiling.chromeTrace("trace.json")
+
+Timers record the wall time of each stage (and a trace event per call, for
+    chrome://tracing or Perfetto). Counters record totals such as bytes read, pixels
+    processed, masked pixels and cache hits. Earth engine functions are timed as they
+    build their client-side graphs; server-side run time isn't visible to the client.
+"""
+
+import functools
+import json
+import os
+import re
+import threading
+import time
+from typing import Callable
+
+from earthlib.config import PROFILE, PROFILE_MAX_EVENTS
+
+_enabled = PROFILE
+_lock = threading.Lock()
+_counters = dict()
+_timers = dict()
+_events = list()
+_origin = time.perf_counter_ns()
+
+
+class Timer:
+    """Context manager recording the wall time of a block of code
+
+    Attributes:
+        name: the stage name to record the time under
+    """
+
+    __slots__ = ("name", "_start")
+
+    def __init__(self, name: str):
+        self.name = name
+
+    def __enter__(self) -> "Timer":
+        self._start = time.perf_counter_ns()
+        return self
+
+    def __exit__(self, *args) -> None:
+        duration = time.perf_counter_ns() - self._start
+        thread = threading.get_ident()
+        with _lock:
+            stats = _timers.get(self.name)
+            if stats is None:
+                _timers[self.name] = [1, duration, duration]
+            else:
+                stats[0] += 1
+                stats[1] += duration
+                stats[2] = max(stats[2], duration)
+            if len(_events) < PROFILE_MAX_EVENTS:
+                _events.append((self.name, self._start, duration, thread))
+
+
+class _NullTimer:
+    """Context manager that does nothing, returned while profiling is disabled"""
+
+    __slots__ = ()
+
+    def __enter__(self) -> "_NullTimer":
+        return self
+
+    def __exit__(self, *args) -> None:
+        return None
+
+
+_null_timer = _NullTimer()
+
+
+def enable() -> None:
+    """Turns on recording for every timer and counter"""
+    global _enabled
+    _enabled = True
+
+
+def disable() -> None:
+    """Turns off recording. Recorded values are kept until reset()"""
+    global _enabled
+    _enabled = False
+
+
+def isEnabled() -> bool:
+    """Returns whether timers and counters are being recorded"""
+    return _enabled
+
+
+def reset() -> None:
+    """Clears every recorded timer, counter and trace event"""
+    global _origin
+    with _lock:
+        _counters.clear()
+        _timers.clear()
+        _events.clear()
+        _origin = time.perf_counter_ns()
+
+
+def timer(name: str):
+    """Returns a context manager that records the wall time of a stage.
+
+    Args:
+        name: the stage name, e.g. "Unmix.fractionalCoverLocal".
+
+    Returns:
+        a Timer if profiling is enabled, or a shared no-op context manager otherwise.
+    """
+    return Timer(name) if _enabled else _null_timer
+
+
+def count(name: str, value: int = 1) -> None:
+    """Adds to a counter.
+
+    Args:
+        name: the counter name, e.g. "read.bytes". names ending in ".hits" and
+            ".misses", or ".masked" and ".pixels", are summarized as a cache hit rate
+            or a masked-pixel fraction (see rates()).
+        value: the amount to add.
+    """
+    if not _enabled:
+        return
+    with _lock:
+        _counters[name] = _counters.get(name, 0) + value
+
+
+def timed(name: str = None) -> Callable:
+    """Decorates a function to record the wall time of every call.
+
+    Args:
+        name: the stage name. defaults to "{module}.{function name}".
+
+    Returns:
+        a decorator. wrapped functions only check a flag while profiling is disabled.
+    """
+
+    def decorator(function: Callable) -> Callable:
+        label = name or f"{function.__module__.split('.')[-1]}.{function.__name__}"
+
+        @functools.wraps(function)
+        def wrapper(*args, **kwargs):
+            if not _enabled:
+                return function(*args, **kwargs)
+            with Timer(label):
+                return function(*args, **kwargs)
+
+        return wrapper
+
+    return decorator
+
+
+def instrument(function: Callable, name: str) -> Callable:
+    """Wraps a function returned by a dispatcher (e.g. bySensor()) with a timer.
+
+    Args:
+        function: the function to time.
+        name: the stage name, e.g. "Scale.Landsat8".
+
+    Returns:
+        the timed function if profiling is enabled, or `function` itself otherwise.
+    """
+    if not _enabled:
+        return function
+
+    count(f"{name}.dispatches")
+    return timed(name)(function)
+
+
+def rates() -> dict:
+    """Derives cache hit rates and masked-pixel fractions from the counters.
+
+    Returns:
+        a dictionary of {"{stage}.hit_rate": float} for counters named "{stage}.hits"
+            and "{stage}.misses", and {"{stage}.masked_fraction": float} for counters
+            named "{stage}.masked" and "{stage}.pixels".
+    """
+    with _lock:
+        counters = dict(_counters)
+
+    derived = dict()
+    for name, value in counters.items():
+        stage, _, kind = name.rpartition(".")
+        if kind == "hits":
+            total = value + counters.get(f"{stage}.misses", 0)
+            derived[f"{stage}.hit_rate"] = value / total if total else 0.0
+        elif kind == "masked" and counters.get(f"{stage}.pixels"):
+            derived[f"{stage}.masked_fraction"] = value / counters[f"{stage}.pixels"]
+
+    return derived
+
+
+def summary() -> dict:
+    """Returns every recorded value as a structured dictionary.
+
+    Returns:
+        a dictionary with "counters" ({name: total}), "timers" ({name: {"count",
+            "total", "mean", "max"}} in seconds) and "rates" (see rates()).
+    """
+    with _lock:
+        counters = dict(_counters)
+        timers = {
+            name: {
+                "count": calls,
+                "total": total / 1e9,
+                "mean": total / calls / 1e9,
+                "max": longest / 1e9,
+            }
+            for name, (calls, total, longest) in _timers.items()
+        }
+
+    return {"counters": counters, "timers": timers, "rates": rates()}
+
+
+def prometheus(prefix: str = "earthlib") -> str:
+    """Formats every recorded value in the Prometheus text exposition format.
+
+    Args:
+        prefix: the prefix for every metric name.
+
+    Returns:
+        the metrics text, e.g. to serve from a /metrics endpoint or write to a file
+            for the node exporter's textfile collector.
+    """
+    recorded = summary()
+    lines = []
+    for name, value in sorted(recorded["counters"].items()):
+        metric = metricName(prefix, name, "total")
+        lines += [f"# TYPE {metric} counter", f"{metric} {value}"]
+
+    for name, stats in sorted(recorded["timers"].items()):
+        metric = metricName(prefix, name, "seconds")
+        lines += [
+            f"# TYPE {metric} summary",
+            f"{metric}_sum {stats['total']}",
+            f"{metric}_count {stats['count']}",
+            f"# TYPE {metric}_max gauge",
+            f"{metric}_max {stats['max']}",
+        ]
+
+    for name, value in sorted(recorded["rates"].items()):
+        metric = metricName(prefix, name)
+        lines += [f"# TYPE {metric} gauge", f"{metric} {value}"]
+
+    return "\n".join(lines) + "\n"
+
+
+def chromeTrace(path: str = None) -> dict:
+    """Exports the recorded timer calls in the Chrome trace event format.
+
+    Args:
+        path: an optional file path to write the trace to as JSON, to open in
+            chrome://tracing or https://ui.perfetto.dev.
+
+    Returns:
+        the trace as a dictionary, with one complete ("X") event per timer call and the
+            final counter values under "otherData".
+    """
+    pid = os.getpid()
+    with _lock:
+        events = list(_events)
+        origin = _origin
+
+    trace = {
+        "traceEvents": [
+            {
+                "name": name,
+                "cat": name.split(".")[0],
+                "ph": "X",
+                "ts": (start - origin) / 1e3,
+                "dur": duration / 1e3,
+                "pid": pid,
+                "tid": thread,
+            }
+            for name, start, duration, thread in events
+        ],
+        "displayTimeUnit": "ms",
+        "otherData": summary()["counters"],
+    }
+
+    if path is not None:
+        with open(path, "w") as f:
+            json.dump(trace, f)
+
+    return trace
+
+
+def metricName(prefix: str, name: str, unit: str = None) -> str:
+    """Converts a stage name to a valid Prometheus metric name"""
+    parts = [prefix, name] + ([unit] if unit else [])
+    return re.sub(r"[^a-zA-Z0-9_]", "_", "_".join(parts))
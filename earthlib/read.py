@@ -1,11 +1,33 @@
 """Functions for reading specifically formatted data, mostly spectral libraries."""
 
+import glob
 import os
+import threading
+from concurrent.futures import ThreadPoolExecutor
+from warnings import warn
 
 import numpy as np
 import spectral
 
-from earthlib.config import endmember_path
+from earthlib import profiling
+from earthlib.config import N_THREADS, ROW_BLOCK_SIZE, endmember_path
+
+# ENVI header "data type" codes
+ENVI_DTYPES = {
+    1: np.uint8,
+    2: np.int16,
+    3: np.int32,
+    4: np.float32,
+    5: np.float64,
+    12: np.uint16,
+    13: np.uint32,
+    14: np.int64,
+    15: np.uint64,
+}
+
+# parsed headers, keyed by file path and modification time
+_header_cache = dict()
+_header_lock = threading.Lock()
 
 
 class Spectra:
@@ -94,24 +116,10 @@ class Spectra:
         else:
             update_val = 0
 
-        if self.band_unit.lower() == "micrometers":
-            water_bands = [[1.35, 1.46], [1.79, 1.96]]
-        else:
-            water_bands = [[1350.0, 1460.0], [1790.0, 1960.0]]
-
-        # start with nir-swir1 transition
-        gt = np.where(self.band_centers > water_bands[0][0])
-        lt = np.where(self.band_centers < water_bands[0][1])
-        nd = np.intersect1d(gt[0], lt[0])
-        self.spectra[:, nd] = update_val
-        self.band_centers = np.delete(self.band_centers, nd)
-
-        # then swir1-swir2 transition
-        gt = np.where(self.band_centers > water_bands[1][0])
-        lt = np.where(self.band_centers < water_bands[1][1])
-        nd = np.intersect1d(gt[0], lt[0])
-        self.spectra[:, nd] = update_val
-        self.band_centers = np.delete(self.band_centers, nd)
+        # mask both the nir-swir1 and swir1-swir2 transitions in one pass
+        mask = waterBandMask(self.band_centers, self.band_unit)
+        fillBands(self.spectra, mask, update_val)
+        self.band_centers = self.band_centers[~mask]
 
     def get_shortwave_bands(self) -> np.ndarray:
         """Returns indices of the bands that encompass the shortwave range.
@@ -148,23 +156,27 @@ class Spectra:
         # check if indices were set and valid. if not, use all bands
         if inds:
             if max(inds) > self.spectra.shape[-1]:
-                inds = range(0, self.spectra.shape[-1])
+                inds = None
                 warn("Invalid range set. using all spectra")
 
-            if min(inds) < 0:
-                inds = range(0, self.spectra.shape[-1])
+            elif min(inds) < 0:
+                inds = None
                 warn("Invalid range set. using all spectra")
 
         else:
-            inds = range(0, self.spectra.shape[-1])
+            inds = None
 
-        # perform the bn
-        self.spectra = self.spectra[:, inds] / np.expand_dims(
-            np.sqrt((self.spectra[:, inds] ** 2).sum(1)), 1
+        # perform the bn, overwriting the spectra if all bands are used
+        in_place = (
+            inds is None
+            and self.spectra.flags.writeable
+            and np.issubdtype(self.spectra.dtype, np.floating)
         )
+        out = self.spectra if in_place else None
+        self.spectra = brightnessNormalize(self.spectra, inds, out=out)
 
         # subset band centers to the indices selected, if they exist
-        if self.band_centers.ndim != 0:
+        if inds is not None and self.band_centers.ndim != 0:
             self.band_centers = self.band_centers[inds]
 
     def write_sli(
@@ -178,57 +190,234 @@ class Spectra:
             spectral_inds: indices for which spectral to write
         """
 
-        # set up the output file names for the library and the header
-        base, ext = os.path.splitext(path)
-        if ext.lower() == ".sli":
-            osli = path
-            ohdr = "{}.hdr".format(base)
-        elif ext.lower() == ".hdr":
-            osli = "{}.hdr".format(base)
-            ohdr = path
-        else:
-            osli = "{}.sli".format(base)
-            ohdr = "{}.hdr".format(base)
-
         # subset the data if specific indices are set
-        spectra = self.spectra
-        names = self.names
+        n_spectra = self.spectra.shape[0]
+        rows = np.arange(n_spectra) if row_inds is None else np.asarray(row_inds)
+        names = np.asarray(self.names)[rows].tolist()
         band_centers = self.band_centers
-
-        if row_inds is not None:
-            spectra = spectra[row_inds, :]
-            names = np.array(names)[row_inds]
-
         if spectral_inds is not None:
-            spectra = spectra[:, spectral_inds]
             band_centers = band_centers[spectral_inds]
 
-        # set up the metadata for the ENVI header file
+        # stream the rows in batches instead of copying the subset all at once
+        with SpectralLibraryWriter(path, band_centers, self.band_unit) as writer:
+            for start in range(0, len(rows), ROW_BLOCK_SIZE):
+                batch = rows[start : start + ROW_BLOCK_SIZE]
+                spectra = self.spectra[batch]
+                if spectral_inds is not None:
+                    spectra = spectra[:, spectral_inds]
+                writer.append(spectra, names[start : start + ROW_BLOCK_SIZE])
+
+
+class SpectralLibraryWriter:
+    """Class for streaming spectra to an ENVI spectral library file in row batches
+
+    Attributes:
+        path: the output spectral library file path
+        header_path: the output header file path
+        band_centers: center wavelength for each band
+        band_unit: the unit of measurement (micrometers or nanometers)
+        names: list of reference names for each spectra written
+    """
+
+    path: str
+    header_path: str
+    band_centers: np.ndarray
+    band_unit: str
+    names: list
+
+    def __init__(
+        self, path: str, band_centers: np.ndarray, band_unit: str = "Nanometers"
+    ):
+        """Open an ENVI spectral library for writing.
+
+        The header (including spectra names and wavelengths) is written on close().
+
+        Args:
+            path: the output file to write to. a .hdr sidecar file is written alongside.
+            band_centers: the center wavelength for each band.
+            band_unit: the unit of measurement (typically micrometers or nanometers).
+        """
+        self.path, self.header_path = libraryPaths(path)
+        self.band_centers = np.asarray(band_centers)
+        self.band_unit = band_unit
+        self.names = list()
+        self._file = open(self.path, "wb")
+
+    def __enter__(self) -> "SpectralLibraryWriter":
+        return self
+
+    def __exit__(self, *args) -> None:
+        self.close()
+
+    def append(self, spectra: np.ndarray, names: list = None) -> None:
+        """Appends a batch of spectra to the library, converting to float32 on the fly.
+
+        Args:
+            spectra: an array of shape (n_spectra, n_bands).
+            names: list of names to assign to each spectra.
+        """
+        spectra = np.atleast_2d(spectra)
+        if spectra.shape[1] != len(self.band_centers):
+            raise ValueError(
+                f"Band mismatch: got {spectra.shape[1]}, expected {len(self.band_centers)}"
+            )
+
+        if names is None:
+            offset = len(self.names)
+            names = [f"Spectrum {offset + i}" for i in range(len(spectra))]
+
+        for start in range(0, len(spectra), ROW_BLOCK_SIZE):
+            batch = spectra[start : start + ROW_BLOCK_SIZE]
+            batch.astype("<f4", copy=False).tofile(self._file)
+
+        self.names.extend(names)
+
+    def close(self) -> None:
+        """Writes the ENVI header and closes the library file."""
+        if self._file.closed:
+            return
+
+        self._file.close()
         metadata = {
-            "samples": len(band_centers),
-            "lines": len(names),
+            "samples": len(self.band_centers),
+            "lines": len(self.names),
             "bands": 1,
             "data type": 4,
             "header offset": 0,
             "interleave": "bsq",
             "byte order": 0,
             "sensor type": "earthlib",
-            "spectra names": names,
+            "spectra names": self.names,
             "wavelength units": self.band_unit,
-            "wavelength": band_centers,
+            "wavelength": self.band_centers,
         }
-        spectral.envi.write_envi_header(ohdr, metadata, is_library=True)
+        spectral.envi.write_envi_header(self.header_path, metadata, is_library=True)
+
+
+def libraryPaths(path: str) -> tuple:
+    """Gets the spectral library and header file paths for an output file name.
+
+    Args:
+        path: an output file name, with or without a .sli or .hdr extension.
+
+    Returns:
+        (sli, hdr): the spectral library and header file paths.
+    """
+    base, ext = os.path.splitext(path)
+    if ext.lower() == ".sli":
+        return path, "{}.hdr".format(base)
+
+    return "{}.sli".format(base), "{}.hdr".format(base)
+
+
+def brightnessNormalize(
+    spectra: np.ndarray,
+    inds: list = None,
+    out: np.ndarray = None,
+    block_size: int = ROW_BLOCK_SIZE,
+    n_threads: int = N_THREADS,
+) -> np.ndarray:
+    """Brightness normalizes spectra with a single fused pass over each row.
+
+    Each row is divided by its euclidean norm. Rows are processed in blocks across
+        a pool of threads, and no full-size temporary arrays are allocated.
+
+    Args:
+        spectra: an array of shape (n_spectra, n_wavelengths).
+        inds: the band indices to use for normalization. the output only contains these bands.
+        out: an optional (n_spectra, n_inds) output array. pass `spectra` itself
+            (with inds=None) to normalize in-place.
+        block_size: the number of rows to normalize per block.
+        n_threads: the number of threads to normalize blocks with.
+
+    Returns:
+        the brightness normalized spectra.
+    """
+    n_spectra = spectra.shape[0]
+    columns = slice(None) if inds is None else np.asarray(inds)
+    n_columns = spectra.shape[1] if inds is None else len(columns)
+    if out is None:
+        dtype = np.result_type(spectra.dtype, np.float32)
+        out = np.empty((n_spectra, n_columns), dtype=dtype)
+
+    def normalizeBlock(start: int) -> None:
+        rows = slice(start, min(start + block_size, n_spectra))
+        block = spectra[rows, columns]
+        norm = np.sqrt(np.einsum("ij,ij->i", block, block))
+        np.divide(block, norm[:, np.newaxis], out=out[rows])
 
-        # then write the spectral library
-        with open(osli, "w") as f:
-            spectra.astype(np.float32).tofile(f)
+    with ThreadPoolExecutor(max_workers=n_threads) as executor:
+        list(executor.map(normalizeBlock, range(0, n_spectra, block_size)))
 
+    return out
 
-def spectralLibrary(path: str) -> Spectra:
-    """Reads an ENVI-format spectral library into memory.
+
+def waterBandMask(band_centers: np.ndarray, band_unit: str) -> np.ndarray:
+    """Flags the bands that fall in the water absorption ranges.
+
+    Args:
+        band_centers: the center wavelength for each band.
+        band_unit: the wavelength unit (micrometers or nanometers).
+
+    Returns:
+        a boolean array, True for bands in (1.35-1.46 um) or (1.79-1.96 um).
+    """
+    if band_unit.lower() == "micrometers":
+        water_bands = [[1.35, 1.46], [1.79, 1.96]]
+    else:
+        water_bands = [[1350.0, 1460.0], [1790.0, 1960.0]]
+
+    band_centers = np.asarray(band_centers)
+    mask = np.zeros(band_centers.shape, dtype=bool)
+    for lower, upper in water_bands:
+        mask |= (band_centers > lower) & (band_centers < upper)
+
+    return mask
+
+
+def fillBands(
+    spectra: np.ndarray,
+    mask: np.ndarray,
+    value: float,
+    block_size: int = ROW_BLOCK_SIZE,
+    n_threads: int = N_THREADS,
+) -> None:
+    """Sets the masked bands of every spectrum to a constant value, in-place.
+
+    The mask is converted to contiguous runs of bands so each row is filled with
+        slice assignments, and rows are processed in blocks across a pool of threads.
+
+    Args:
+        spectra: an array of shape (n_spectra, n_wavelengths).
+        mask: a boolean array of shape (n_wavelengths,) flagging the bands to fill.
+        value: the fill value.
+        block_size: the number of rows to fill per block.
+        n_threads: the number of threads to fill blocks with.
+    """
+    edges = np.diff(np.concatenate([[0], mask.astype(np.int8), [0]]))
+    runs = list(zip(np.flatnonzero(edges == 1), np.flatnonzero(edges == -1)))
+    n_spectra = spectra.shape[0]
+
+    def fillBlock(start: int) -> None:
+        rows = slice(start, min(start + block_size, n_spectra))
+        for lower, upper in runs:
+            spectra[rows, lower:upper] = value
+
+    with ThreadPoolExecutor(max_workers=n_threads) as executor:
+        list(executor.map(fillBlock, range(0, n_spectra, block_size)))
+
+
+@profiling.timed()
+def spectralLibrary(path: str, read_only: bool = False) -> Spectra:
+    """Reads an ENVI-format spectral library without copying it into memory.
+
+    The header is parsed once per file and the reflectance data are memory-mapped,
+        so `Spectra.spectra` is a zero-copy numpy view of the file on disk.
 
     Args:
         path: file path to the ENVI spectral library file. Looks for a .hdr sidecar file.
+        read_only: map the data read-only. otherwise the map is copy-on-write, so
+            in-place edits (e.g. remove_water_bands()) never modify the file.
 
     Returns:
         an earthlib Spectra with the spectral library data.
@@ -243,18 +432,98 @@ def spectralLibrary(path: str) -> Spectra:
         else:
             return None
 
-    slib = spectral.envi.open(hdr, path)
+    header = readEnviHeader(hdr)
+    data = np.memmap(
+        path,
+        dtype=enviDtype(header),
+        mode="r" if read_only else "c",
+        offset=int(header.get("header offset", 0)),
+        shape=(int(header["lines"]), int(header["samples"])),
+    )
+    profiling.count("read.bytes", data.nbytes)
+
+    # libraries without wavelengths get the Spectra defaults (e.g. asd band centers)
+    wavelength = header.get("wavelength")
+    if wavelength is not None:
+        wavelength = np.asarray(wavelength, dtype=float)
     s = Spectra(
-        data=slib.spectra,
-        names=slib.names,
-        band_centers=np.asarray(slib.bands.centers),
-        band_unit=slib.bands.band_unit,
-        band_quantity=slib.bands.band_quantity,
+        data=data,
+        names=header.get("spectra names"),
+        band_centers=wavelength,
+        band_unit=header.get("wavelength units", "Unknown"),
+        band_quantity="Wavelength",
     )
 
     return s
 
 
+def readEnviHeader(path: str) -> dict:
+    """Parses an ENVI header file, caching the result until the file changes.
+
+    Args:
+        path: file path to the ENVI .hdr file.
+
+    Returns:
+        a dictionary of lower-case header keys. brace-enclosed fields
+            (e.g. "spectra names", "wavelength") are returned as lists of strings.
+            each call returns new lists, so callers can edit them freely.
+    """
+    key = (os.path.realpath(path), os.path.getmtime(path))
+    with _header_lock:
+        if key in _header_cache:
+            return copyHeader(_header_cache[key])
+
+    with open(path, "r") as f:
+        lines = iter(f.read().splitlines())
+
+    header = dict()
+    for line in lines:
+        if "=" not in line:
+            continue
+
+        field, value = [part.strip() for part in line.split("=", 1)]
+        if value.startswith("{"):
+            while "}" not in value:
+                value += " " + next(lines, "}").strip()
+            value = [item.strip() for item in value.strip("{} ").split(",")]
+
+        header[field.lower()] = value
+
+    with _header_lock:
+        _header_cache[key] = header
+
+    return copyHeader(header)
+
+
+def copyHeader(header: dict) -> dict:
+    """Copies a parsed ENVI header, including its list fields.
+
+    Args:
+        header: a parsed ENVI header (from readEnviHeader()).
+
+    Returns:
+        a new dictionary with new lists for the brace-enclosed fields.
+    """
+    return {
+        field: list(value) if isinstance(value, list) else value
+        for field, value in header.items()
+    }
+
+
+def enviDtype(header: dict) -> np.dtype:
+    """Gets the numpy data type from the ENVI "data type" and "byte order" fields.
+
+    Args:
+        header: a parsed ENVI header (from readEnviHeader()).
+
+    Returns:
+        the numpy dtype of the binary data.
+    """
+    dtype = np.dtype(ENVI_DTYPES[int(header["data type"])])
+    byte_order = ">" if int(header.get("byte order", 0)) == 1 else "<"
+    return dtype.newbyteorder(byte_order)
+
+
 def endmembers() -> Spectra:
     """Reads the earthlib spectral endmember library into memory.
 
@@ -279,20 +548,22 @@ def jfsp(path: str) -> Spectra:
     """
 
     # create the spectral object
-    s = spectralObject(n_spectra=1, instrument="asd")
+    s = Spectra(n_spectra=1, instrument="asd")
     s.spectra_stdevm = np.zeros(s.spectra.shape)
     s.spectra_stdevp = np.zeros(s.spectra.shape)
 
-    # open the file and read the data
+    # skip the header line and parse the (wavelength, mean, +std, -std) columns at once
     with open(path, "r") as f:
         f.readline()
-        for i, line in enumerate(f):
-            line = line.strip().split()
-            s.spectra[0, i] = line[1]
-            s.spectra_stdevp[0, i] = line[2]
-            s.spectra_stdevm[0, i] = line[3]
+        table = parseColumns(f.read(), n_columns=4)
 
-        return s
+    n_values = min(len(table), s.spectra.shape[1])
+    s.spectra[0, :n_values] = table[:n_values, 1]
+    s.spectra_stdevp[0, :n_values] = table[:n_values, 2]
+    s.spectra_stdevm[0, :n_values] = table[:n_values, 3]
+    s.names[0] = os.path.splitext(os.path.basename(path))[0]
+
+    return s
 
 
 def usgs(path: str) -> Spectra:
@@ -311,69 +582,149 @@ def usgs(path: str) -> Spectra:
 
     # open the file and read header info
     with open(path, "r") as f:
-        x_start = "gibberish"
-        for line in f:
-            if x_start in line:
+        lines = f.read().splitlines()
+
+    spectrum_name = None
+    band_unit = "Unknown"
+    refl_unit = "Unknown"
+    x_start = None
+    n_values = None
+    for start, line in enumerate(lines):
+        if x_start is not None:
+            tokens = line.split()
+            if tokens and isFloat(tokens[0]) and float(tokens[0]) == x_start:
                 break
-            if "Name:" in line:
-                spectrum_name = line.strip().split("Name:")[-1].strip()
-            if "X Units:" in line:
-                band_unit = line.strip().split()
-                band_unit = band_unit[-1].strip("()").capitalize()
-            if "Y Units:" in line:
-                refl_unit = line.strip().split()
-                refl_unit = refl_unit[-1].strip("()").capitalize()
-            if "First X Value:" in line:
-                x_start = line.strip().split()[-1]
-            if "Number of X Values:" in line:
-                n_values = int(line.strip().split()[-1])
-
-        # now that we got our header info, create the arrays
-        band_centers = np.empty(n_values)
-        reflectance = np.empty(n_values)
-
-        line = line.strip().split()
-        band_centers[0] = float(line[0])
-        reflectance[0] = float(line[1])
-
-        # resume reading through file
-        i = 1
-        for line in f:
-            line = line.strip().split()
-            band_centers[i] = float(line[0])
-            reflectance[i] = float(line[1])
-            i += 1
-
-        # some files read last -> first wavelength
-        if band_centers[0] > band_centers[-1]:
-            band_centers = band_centers[::-1]
-            reflectance = reflectance[::1]
-
-        # convert units to nanometers and scale 0-1
-        if band_unit.lower() == "micrometers":
-            band_centers *= 1000.0
-            band_unit = "Nanometers"
-
-        if refl_unit.lower() == "percent":
-            reflectance /= 100.0
-
-        # create the spectral object
-        s = Spectra(
-            n_spectra=1,
-            n_wavelengths=n_values,
-            band_centers=band_centers,
-            band_unit=band_unit,
-            band_quantity="Wavelength",
-        )
+        if "Name:" in line:
+            spectrum_name = line.strip().split("Name:")[-1].strip()
+        if "X Units:" in line:
+            band_unit = line.strip().split()[-1].strip("()").capitalize()
+        if "Y Units:" in line:
+            refl_unit = line.strip().split()[-1].strip("()").capitalize()
+        if "First X Value:" in line:
+            x_start = float(line.strip().split()[-1])
+        if "Number of X Values:" in line:
+            n_values = int(line.strip().split()[-1])
+    else:
+        raise ValueError(f"No spectral data found in {path}")
 
-        # assign relevant values
-        s.spectra[0] = reflectance
-        if spectrum_name:
-            s.names[0] = spectrum_name
+    # parse the (wavelength, reflectance) pairs in a single call
+    table = parseColumns("\n".join(lines[start:]), n_columns=2)
+    if n_values is not None:
+        table = table[:n_values]
+    band_centers = table[:, 0].copy()
+    reflectance = table[:, 1].copy()
+
+    # some files read last -> first wavelength
+    if band_centers[0] > band_centers[-1]:
+        band_centers = band_centers[::-1]
+        reflectance = reflectance[::-1]
+
+    # convert units to nanometers and scale 0-1
+    if band_unit.lower() == "micrometers":
+        band_centers *= 1000.0
+        band_unit = "Nanometers"
+
+    if refl_unit.lower() == "percent":
+        reflectance /= 100.0
+
+    # create the spectral object
+    s = Spectra(
+        data=reflectance[np.newaxis, :],
+        band_centers=band_centers,
+        band_unit=band_unit,
+        band_quantity="Wavelength",
+    )
+    if spectrum_name:
+        s.names[0] = spectrum_name
+
+    return s
+
+
+def readDirectory(
+    directory: str,
+    fmt: str = "usgs",
+    pattern: str = "*.txt",
+    n_threads: int = N_THREADS,
+) -> Spectra:
+    """Reads every ASCII spectra file in a directory into a single spectral library.
+
+    Files are parsed in parallel, and each spectrum is interpolated to the wavelengths
+        of the first file read (in sorted order) if their wavelengths differ.
+
+    Args:
+        directory: the directory to search for spectra files.
+        fmt: the file format. supported values are "usgs" and "jfsp".
+        pattern: the glob pattern for selecting files in the directory.
+        n_threads: the number of files to parse concurrently.
+
+    Returns:
+        an earthlib Spectra with one contiguous row per file.
+    """
+    readers = {"usgs": usgs, "jfsp": jfsp}
+    if fmt.lower() not in readers:
+        raise ValueError(f"Unsupported format: {fmt}. Supported: {list(readers)}")
+    reader = readers[fmt.lower()]
+
+    paths = sorted(glob.glob(os.path.join(directory, pattern)))
+    if len(paths) == 0:
+        raise FileNotFoundError(f"No files matching {pattern} in {directory}")
+
+    with ThreadPoolExecutor(max_workers=max(1, n_threads)) as pool:
+        libraries = list(pool.map(reader, paths))
+
+    reference = libraries[0]
+    band_centers = np.asarray(reference.band_centers, dtype=float)
+    data = np.empty((len(libraries), len(band_centers)), dtype=np.float32)
+    for i, library in enumerate(libraries):
+        centers = np.asarray(library.band_centers, dtype=float)
+        if np.array_equal(centers, band_centers):
+            data[i] = library.spectra[0]
+        else:
+            data[i] = np.interp(band_centers, centers, library.spectra[0])
+
+    s = Spectra(
+        data=data,
+        names=[library.names[0] for library in libraries],
+        band_centers=band_centers,
+        band_unit=reference.band_unit,
+        band_quantity="Wavelength",
+    )
 
     return s
 
 
+def parseColumns(text: str, n_columns: int) -> np.ndarray:
+    """Parses whitespace-delimited numeric text into an array in a single call.
+
+    Args:
+        text: the table text, with no header lines.
+        n_columns: the number of values on each line.
+
+    Returns:
+        an array of shape (n_lines, n_columns). trailing partial rows are dropped.
+    """
+    values = np.fromstring(text, dtype=float, sep=" ")
+    n_rows = len(values) // n_columns
+
+    return values[: n_rows * n_columns].reshape(n_rows, n_columns)
+
+
+def isFloat(token: str) -> bool:
+    """Checks whether a string can be parsed as a float.
+
+    Args:
+        token: the string to check.
+
+    Returns:
+        whether float(token) succeeds.
+    """
+    try:
+        float(token)
+        return True
+    except ValueError:
+        return False
+
+
 def check_file(path: str) -> bool:
     """Verifies whether a file exists and can be read.
 
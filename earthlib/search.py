@@ -0,0 +1,521 @@
+"""Nearest-neighbor search and pruning for spectral libraries."""
+
+import numpy as np
+
+from earthlib.buffers import asArray
+from earthlib.config import (
+    DEDUPE_ANGLE,
+    DEDUPE_NEIGHBORS,
+    IVF_ITERATIONS,
+    IVF_MIN_SPECTRA,
+    IVF_N_PROBE,
+    RANDOM_SEED,
+    SEARCH_BLOCK_SIZE,
+    SEARCH_METRIC,
+    SEARCH_METRICS,
+)
+from earthlib.read import brightnessNormalize
+from earthlib.utils import (
+    getEndmemberLibrary,
+    randomGenerator,
+    sensorResponse,
+    validateSensor,
+    validateType,
+)
+
+PRUNE_METHODS = ["ear", "masa"]
+
+
+class SpectralIndex:
+    """Class for k-nearest neighbor lookups against a spectral library
+
+    Small libraries are searched exhaustively with blocked matrix products. Large
+        libraries are partitioned into k-means clusters (an inverted file index), and
+        each query only searches the spectra in the `n_probe` clusters with the
+        nearest centroids.
+
+    Attributes:
+        spectra: the (n_spectra, n_bands) float32 library, stored as unit vectors for
+            the "angle" metric and brightness normalized for "euclidean" (by default)
+        metric: the distance metric. "angle" returns spectral angles in radians,
+            "euclidean" returns euclidean distances.
+        centroids: the (n_lists, n_bands) cluster centroids. None for exhaustive search.
+        n_probe: the number of clusters searched per query
+    """
+
+    spectra: np.ndarray
+    metric: str
+    centroids: np.ndarray
+    n_probe: int
+
+    def __init__(
+        self,
+        spectra: np.ndarray,
+        metric: str = SEARCH_METRIC,
+        normalize: bool = True,
+        n_lists: int = None,
+        n_probe: int = IVF_N_PROBE,
+        seed: int = RANDOM_SEED,
+    ):
+        """Builds the search index.
+
+        Args:
+            spectra: an array of shape (n_spectra, n_bands), e.g. from
+                EndmemberLibrary.resample().
+            metric: the distance metric ("angle" or "euclidean").
+            normalize: brightness normalize spectra (and queries) before computing
+                euclidean distances. spectral angles are independent of brightness.
+            n_lists: the number of k-means clusters to partition the library into.
+                0 searches exhaustively. defaults to sqrt(n_spectra) for libraries
+                with at least IVF_MIN_SPECTRA spectra, and 0 otherwise.
+            n_probe: the default number of clusters searched per query.
+            seed: the random seed for the k-means initialization.
+        """
+        validateMetric(metric)
+        self.metric = metric
+        self.normalize = normalize or metric == "angle"
+        self.n_probe = n_probe
+        self.spectra = self.transform(spectra)
+        self._norms = np.einsum("ij,ij->i", self.spectra, self.spectra)
+
+        n_spectra = len(self.spectra)
+        if n_lists is None:
+            n_lists = int(np.sqrt(n_spectra)) if n_spectra >= IVF_MIN_SPECTRA else 0
+
+        self.centroids = None
+        if n_lists > 0:
+            self.centroids, labels = kMeans(self.spectra, n_lists, seed=seed)
+            counts = np.bincount(labels, minlength=len(self.centroids))
+            self._order = np.argsort(labels, kind="stable")
+            self._offsets = np.concatenate([[0], np.cumsum(counts)])
+
+    def __len__(self) -> int:
+        return len(self.spectra)
+
+    def transform(self, spectra: np.ndarray) -> np.ndarray:
+        """Converts spectra to the representation the index searches over.
+
+        Args:
+            spectra: an array of shape (n, n_bands).
+
+        Returns:
+            a contiguous float32 array of shape (n, n_bands).
+        """
+        spectra = np.atleast_2d(asArray(spectra, dtype=np.float32))
+        if self.normalize:
+            spectra = brightnessNormalize(spectra, n_threads=1)
+        return np.ascontiguousarray(spectra)
+
+    def query(
+        self, pixels: np.ndarray, k: int = 1, n_probe: int = None
+    ) -> tuple:
+        """Finds the nearest library spectra to each query spectrum.
+
+        Args:
+            pixels: an array of shape (n_pixels, n_bands) in the library's bands.
+            k: the number of neighbors to return per pixel.
+            n_probe: the number of clusters to search. defaults to the index n_probe.
+                ignored for exhaustive search.
+
+        Returns:
+            distances: a float32 array of shape (n_pixels, k), sorted nearest first.
+            indices: the library row index of each neighbor. pixels with fewer than k
+                candidates in the searched clusters are padded with -1 (at infinite
+                distance).
+        """
+        queries = self.transform(pixels)
+        k = min(k, len(self))
+        if self.centroids is None:
+            return self._searchAll(queries, k)
+
+        return self._searchLists(queries, k, n_probe or self.n_probe)
+
+    def distances(self, queries: np.ndarray, members: np.ndarray = None):
+        """Computes the distances between transformed queries and library spectra.
+
+        Args:
+            queries: an (n, n_bands) array (from transform()).
+            members: the library rows to compute distances to. defaults to every row.
+
+        Returns:
+            an (n, n_members) float32 array of distances.
+        """
+        if members is None:
+            return pairwiseDistances(queries, self.spectra, self._norms, self.metric)
+
+        spectra, norms = self.spectra[members], self._norms[members]
+        return pairwiseDistances(queries, spectra, norms, self.metric)
+
+    def _searchAll(self, queries: np.ndarray, k: int) -> tuple:
+        """Searches every library spectrum, a block of queries at a time"""
+        n_queries = len(queries)
+        distances = np.empty((n_queries, k), dtype=np.float32)
+        indices = np.empty((n_queries, k), dtype=np.intp)
+        block_size = max(1, SEARCH_BLOCK_SIZE // max(1, len(self)))
+        for start in range(0, n_queries, block_size):
+            rows = slice(start, start + block_size)
+            distances[rows], indices[rows] = smallest(self.distances(queries[rows]), k)
+
+        return distances, indices
+
+    def _searchLists(self, queries: np.ndarray, k: int, n_probe: int) -> tuple:
+        """Searches the spectra in the clusters nearest each query"""
+        n_queries = len(queries)
+        n_lists = len(self.centroids)
+        n_probe = min(n_probe, n_lists)
+        probes = np.empty((n_queries, n_probe), dtype=np.intp)
+        block_size = max(1, SEARCH_BLOCK_SIZE // n_lists)
+        for start in range(0, n_queries, block_size):
+            rows = slice(start, start + block_size)
+            squared = squaredDistances(queries[rows], self.centroids)
+            probes[rows] = smallest(squared, n_probe)[1]
+
+        # group queries by the clusters they probe, then search one cluster at a time
+        flat = probes.ravel()
+        grouped = np.argsort(flat, kind="stable") // n_probe
+        bounds = np.concatenate([[0], np.cumsum(np.bincount(flat, minlength=n_lists))])
+
+        distances = np.full((n_queries, k), np.inf, dtype=np.float32)
+        indices = np.full((n_queries, k), -1, dtype=np.intp)
+        for cluster in range(n_lists):
+            members = self._order[self._offsets[cluster] : self._offsets[cluster + 1]]
+            probing = grouped[bounds[cluster] : bounds[cluster + 1]]
+            if len(members) == 0 or len(probing) == 0:
+                continue
+
+            spectra, norms = self.spectra[members], self._norms[members]
+            block_size = max(1, SEARCH_BLOCK_SIZE // len(members))
+            for start in range(0, len(probing), block_size):
+                rows = probing[start : start + block_size]
+                found = pairwiseDistances(queries[rows], spectra, norms, self.metric)
+                merged = np.concatenate([distances[rows], found], axis=1)
+                candidates = np.concatenate(
+                    [indices[rows], np.broadcast_to(members, found.shape)], axis=1
+                )
+                distances[rows], nearest = smallest(merged, k)
+                indices[rows] = np.take_along_axis(candidates, nearest, axis=1)
+
+        return distances, indices
+
+
+def validateMetric(metric: str) -> None:
+    """Verify a distance metric is supported, raise an error otherwise.
+
+    Args:
+        metric: the name of the distance metric (e.g. "angle", "euclidean").
+
+    Raises:
+        ValueError: when an unsupported metric is passed
+    """
+    if metric not in SEARCH_METRICS:
+        raise ValueError(
+            f"Invalid metric: {metric}. Supported: {', '.join(SEARCH_METRICS)}"
+        )
+
+
+def smallest(distances: np.ndarray, k: int) -> tuple:
+    """Selects the k smallest values in each row of a distance matrix.
+
+    Args:
+        distances: an array of shape (n, m), with k <= m.
+        k: the number of values to select per row.
+
+    Returns:
+        the (n, k) sorted values and their (n, k) column indices.
+    """
+    nearest = np.argpartition(distances, k - 1, axis=1)[:, :k]
+    values = np.take_along_axis(distances, nearest, axis=1)
+    order = np.argsort(values, axis=1, kind="stable")
+    return (
+        np.take_along_axis(values, order, axis=1),
+        np.take_along_axis(nearest, order, axis=1),
+    )
+
+
+def pairwiseDistances(
+    queries: np.ndarray, spectra: np.ndarray, norms: np.ndarray, metric: str
+) -> np.ndarray:
+    """Computes the distances between two sets of spectra with one matrix product.
+
+    Args:
+        queries: an array of shape (n, n_bands).
+        spectra: an array of shape (m, n_bands). unit vectors for the "angle" metric.
+        norms: the (m,) squared norms of the spectra.
+        metric: the distance metric ("angle" or "euclidean").
+
+    Returns:
+        an (n, m) array of distances.
+    """
+    dots = queries @ spectra.T
+    if metric == "angle":
+        return np.arccos(np.clip(dots, -1, 1, out=dots), out=dots)
+
+    dots *= -2
+    dots += np.einsum("ij,ij->i", queries, queries)[:, np.newaxis]
+    dots += norms
+    return np.sqrt(np.maximum(dots, 0, out=dots), out=dots)
+
+
+def squaredDistances(a: np.ndarray, b: np.ndarray) -> np.ndarray:
+    """Computes the squared euclidean distances between two sets of vectors.
+
+    Args:
+        a: an array of shape (n, n_bands).
+        b: an array of shape (m, n_bands).
+
+    Returns:
+        an (n, m) array of squared distances.
+    """
+    squared = a @ b.T
+    squared *= -2
+    squared += np.einsum("ij,ij->i", a, a)[:, np.newaxis]
+    squared += np.einsum("ij,ij->i", b, b)
+    return np.maximum(squared, 0, out=squared)
+
+
+def kMeans(
+    vectors: np.ndarray,
+    n_clusters: int,
+    n_iterations: int = IVF_ITERATIONS,
+    seed: int = RANDOM_SEED,
+) -> tuple:
+    """Clusters vectors with Lloyd's algorithm.
+
+    Args:
+        vectors: an array of shape (n, n_bands).
+        n_clusters: the number of clusters. capped at n.
+        n_iterations: the maximum number of iterations. stops early once no vectors
+            change clusters.
+        seed: the random seed for selecting the initial centroids.
+
+    Returns:
+        centroids: an (n_clusters, n_bands) array of cluster means.
+        labels: the cluster index of each vector.
+    """
+    n_clusters = min(n_clusters, len(vectors))
+    rng = randomGenerator(seed)
+    centroids = vectors[rng.choice(len(vectors), n_clusters, replace=False)].copy()
+    labels = np.full(len(vectors), -1, dtype=np.intp)
+    block_size = max(1, SEARCH_BLOCK_SIZE // n_clusters)
+
+    for _ in range(n_iterations):
+        previous = labels.copy()
+        for start in range(0, len(vectors), block_size):
+            rows = slice(start, start + block_size)
+            squared = squaredDistances(vectors[rows], centroids)
+            labels[rows] = np.argmin(squared, axis=1)
+
+        if np.array_equal(labels, previous):
+            break
+
+        # empty clusters keep their previous centroid
+        counts = np.bincount(labels, minlength=n_clusters)
+        sums = np.zeros(centroids.shape, dtype=np.float64)
+        np.add.at(sums, labels, vectors)
+        filled = counts > 0
+        centroids[filled] = sums[filled] / counts[filled, np.newaxis]
+
+    return centroids, labels
+
+
+def libraryIndex(
+    sensor: str,
+    Type: str = None,
+    bands: list = None,
+    response: np.ndarray = None,
+    metric: str = SEARCH_METRIC,
+    n_lists: int = None,
+) -> tuple:
+    """Builds a search index over the earthlib library resampled to a sensor.
+
+    Args:
+        sensor: the sensor type to resample wavelengths to.
+        Type: an optional type of spectra to index (from earthlib.listTypes()).
+            indexes the full library if not set.
+        bands: list of bands to use. Accepts 0-based indices or a list of band names.
+        response: a custom (n_bands, n_wavelengths) spectral response matrix.
+        metric: the distance metric ("angle" or "euclidean").
+        n_lists: the number of k-means clusters (see SpectralIndex).
+
+    Returns:
+        index: a SpectralIndex over the resampled spectra.
+        rows: the library row index of each indexed spectrum.
+    """
+    validateSensor(sensor)
+    library = getEndmemberLibrary()
+    response = sensorResponse(sensor, bands, response)
+    if Type is None:
+        spectra = library.resample(response)
+        rows = np.arange(len(spectra))
+    else:
+        validateType(Type)
+        rows = library.typeIndices(Type)
+        spectra = library.subset(Type, response)
+
+    return SpectralIndex(spectra, metric=metric, n_lists=n_lists), rows
+
+
+def nearestSpectra(
+    pixels: np.ndarray,
+    sensor: str,
+    k: int = 1,
+    Type: str = None,
+    bands: list = None,
+    metric: str = SEARCH_METRIC,
+) -> tuple:
+    """Finds the earthlib library spectra closest to each pixel.
+
+    Args:
+        pixels: an (n_pixels, n_bands) array of reflectance in the sensor's bands.
+        sensor: the sensor type to resample the library to.
+        k: the number of neighbors to return per pixel.
+        Type: an optional type of spectra to search (from earthlib.listTypes()).
+        bands: list of bands to use. Accepts 0-based indices or a list of band names.
+        metric: the distance metric ("angle" or "euclidean").
+
+    Returns:
+        distances: an (n_pixels, k) array, sorted nearest first.
+        rows: the library row index of each neighbor (matching earthlib.metadata).
+    """
+    index, rows = libraryIndex(sensor, Type, bands, metric=metric)
+    distances, indices = index.query(pixels, k)
+    return distances, np.where(indices >= 0, rows[indices], -1)
+
+
+def deduplicate(
+    spectra: np.ndarray,
+    threshold: float = DEDUPE_ANGLE,
+    n_neighbors: int = DEDUPE_NEIGHBORS,
+    index: SpectralIndex = None,
+) -> np.ndarray:
+    """Removes near-duplicate spectra, keeping the first of each group.
+
+    A spectrum is dropped when one of its nearest neighbors that comes earlier in the
+        library, and was kept, is within the threshold spectral angle.
+
+    Args:
+        spectra: an array of shape (n_spectra, n_bands).
+        threshold: the spectral angle (in radians) below which spectra are duplicates.
+        n_neighbors: the number of nearest neighbors checked per spectrum.
+        index: an optional "angle" SpectralIndex over the same spectra.
+
+    Returns:
+        the sorted row indices of the spectra kept.
+    """
+    if index is None:
+        index = SpectralIndex(spectra, metric="angle")
+    angles, neighbors = index.query(index.spectra, n_neighbors + 1)
+
+    keep = np.ones(len(index), dtype=bool)
+    earlier = (neighbors < np.arange(len(index))[:, np.newaxis]) & (neighbors >= 0)
+    duplicates = earlier & (angles <= threshold)
+    for row in np.flatnonzero(duplicates.any(axis=1)):
+        keep[row] = not keep[neighbors[row, duplicates[row]]].any()
+
+    return np.flatnonzero(keep)
+
+
+def averageAngles(spectra: np.ndarray) -> np.ndarray:
+    """Computes the minimum average spectral angle (MASA) score of each spectrum.
+
+    Args:
+        spectra: an array of shape (n_spectra, n_bands) from a single class.
+
+    Returns:
+        the mean spectral angle (in radians) between each spectrum and every other
+            spectrum in the class. lower scores better represent the class.
+    """
+    index = SpectralIndex(spectra, metric="angle", n_lists=0)
+    n_spectra = len(index)
+    scores = np.empty(n_spectra, dtype=np.float64)
+    block_size = max(1, SEARCH_BLOCK_SIZE // n_spectra)
+    for start in range(0, n_spectra, block_size):
+        rows = slice(start, start + block_size)
+        angles = index.distances(index.spectra[rows])
+        diagonal = np.arange(angles.shape[0])
+        angles[diagonal, start + diagonal] = 0
+        scores[rows] = angles.sum(axis=1)
+
+    return scores / max(1, n_spectra - 1)
+
+
+def averageRMSE(spectra: np.ndarray) -> np.ndarray:
+    """Computes the endmember average RMSE (EAR) score of each spectrum.
+
+    Each spectrum is used as a single endmember, with photometric shade, to model
+        every other spectrum in the class. The best-fit fraction has a closed form,
+        so every model is computed at once from the matrix of dot products.
+
+    Args:
+        spectra: an array of shape (n_spectra, n_bands) from a single class.
+
+    Returns:
+        the mean RMSE of the models using each spectrum. lower scores better
+            represent the class.
+    """
+    spectra = np.atleast_2d(asArray(spectra, dtype=np.float64))
+    n_spectra, n_bands = spectra.shape
+    squares = np.einsum("ij,ij->i", spectra, spectra)
+    scores = np.empty(n_spectra, dtype=np.float64)
+    block_size = max(1, SEARCH_BLOCK_SIZE // n_spectra)
+    for start in range(0, n_spectra, block_size):
+        columns = slice(start, start + block_size)
+
+        # residual sum of squares of modeling pixel i with endmember j
+        dots = spectra @ spectra[columns].T
+        with np.errstate(divide="ignore", invalid="ignore"):
+            fits = np.square(dots) / squares[columns]
+        residuals = squares[:, np.newaxis] - fits
+        rmse = np.sqrt(np.maximum(residuals, 0) / n_bands)
+        diagonal = np.arange(rmse.shape[1])
+        rmse[start + diagonal, diagonal] = 0
+        scores[columns] = rmse.sum(axis=0)
+
+    return scores / max(1, n_spectra - 1)
+
+
+def pruneLibrary(
+    spectra: np.ndarray,
+    labels: np.ndarray,
+    n: int = None,
+    method: str = "ear",
+    threshold: float = DEDUPE_ANGLE,
+) -> np.ndarray:
+    """Selects the most representative spectra of each class in a library.
+
+    Near-duplicates are removed first (see deduplicate()), then the remaining spectra
+        in each class are ranked by their EAR or MASA scores.
+
+    Args:
+        spectra: an array of shape (n_spectra, n_bands), e.g. the library reflectance
+            resampled to a sensor.
+        labels: the class label of each spectrum (e.g. earthlib.metadata["LEVEL_2"]).
+        n: the number of spectra to keep per class. keeps every deduplicated spectrum,
+            in rank order, if not set.
+        method: the ranking score. "ear" (endmember average RMSE) or "masa" (minimum
+            average spectral angle).
+        threshold: the duplicate spectral angle in radians. 0 skips deduplication.
+
+    Returns:
+        the row indices of the spectra kept, grouped by class in order of first
+            appearance and ranked within each class.
+    """
+    if method not in PRUNE_METHODS:
+        raise ValueError(
+            f"Invalid method: {method}. Supported: {', '.join(PRUNE_METHODS)}"
+        )
+    score = averageRMSE if method == "ear" else averageAngles
+
+    spectra = np.atleast_2d(asArray(spectra))
+    labels = np.asarray(labels)
+    rows = np.arange(len(spectra))
+    if threshold > 0:
+        rows = deduplicate(spectra, threshold)
+
+    selected = []
+    for label in dict.fromkeys(labels[rows]):
+        members = rows[labels[rows] == label]
+        ranked = members[np.argsort(score(spectra[members]), kind="stable")]
+        selected.append(ranked[:n])
+
+    return np.concatenate(selected) if selected else rows
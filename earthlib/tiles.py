@@ -0,0 +1,362 @@
+"""Tiled execution of local kernels on in-memory arrays and rasters on disk."""
+
+import os
+import threading
+from collections import deque
+from concurrent.futures import ThreadPoolExecutor
+from contextlib import ExitStack
+from typing import Callable, Iterable, Iterator
+
+import numpy as np
+
+from earthlib import profiling
+from earthlib.config import INT16_NODATA, N_THREADS, TILES_IN_FLIGHT
+
+
+class TileScheduler:
+    """Class for processing tiles across a thread pool with bounded memory
+
+    Tiles are read and processed by worker threads and handed back in the order they
+        were submitted. Only `max_in_flight` tiles are queued, running or waiting to be
+        written at any time, so memory use is bounded by the tile size rather than the
+        raster size, and reading the next tiles overlaps with writing the previous ones.
+
+    Attributes:
+        n_threads: the number of worker threads
+        max_in_flight: the maximum number of tiles held in memory at once
+    """
+
+    n_threads: int
+    max_in_flight: int
+
+    def __init__(
+        self, n_threads: int = N_THREADS, max_in_flight: int = TILES_IN_FLIGHT
+    ):
+        """Set up a tile scheduler.
+
+        Args:
+            n_threads: the number of worker threads.
+            max_in_flight: the maximum number of tiles held in memory at once. at least
+                `n_threads` to keep every worker busy.
+        """
+        self.n_threads = max(1, n_threads)
+        self.max_in_flight = max(1, max_in_flight)
+
+    def map(self, function: Callable, windows: Iterable) -> Iterator:
+        """Applies a function to each tile window, yielding results in window order.
+
+        Args:
+            function: a function that reads and processes a single tile window.
+            windows: the tile windows to process (e.g. from blockWindows()).
+
+        Yields:
+            (window, result) tuples, in the order of `windows`.
+        """
+        with ThreadPoolExecutor(max_workers=self.n_threads) as executor:
+            pending = deque()
+            for window in windows:
+                if len(pending) >= self.max_in_flight:
+                    done, future = pending.popleft()
+                    yield done, future.result()
+                pending.append((window, executor.submit(function, window)))
+                profiling.count("tiles.tiles")
+
+            while pending:
+                done, future = pending.popleft()
+                yield done, future.result()
+
+    def run(self, function: Callable, write: Callable, windows: Iterable) -> None:
+        """Processes tile windows on the thread pool and writes the results in order.
+
+        Args:
+            function: a function that reads and processes a single tile window.
+            write: a function called with (window, result) for each processed tile.
+                always called from the calling thread, so it needn't be thread-safe.
+            windows: the tile windows to process (e.g. from blockWindows()).
+        """
+        for window, result in self.map(function, windows):
+            write(window, result)
+
+
+def blockWindows(shape: tuple, block_shape: tuple) -> list:
+    """Splits a 2D array shape into tile windows.
+
+    Args:
+        shape: the (rows, cols) shape to split.
+        block_shape: the (rows, cols) shape of each tile. edge tiles may be smaller.
+
+    Returns:
+        a list of (row_offset, col_offset, n_rows, n_cols) windows in row-major order.
+    """
+    rows, cols = shape
+    block_rows, block_cols = block_shape
+    return [
+        (row, col, min(block_rows, rows - row), min(block_cols, cols - col))
+        for row in range(0, rows, block_rows)
+        for col in range(0, cols, block_cols)
+    ]
+
+
+def stripWindows(shape: tuple, block_rows: int) -> list:
+    """Splits a 2D array shape into full-width strips of rows.
+
+    Args:
+        shape: the (rows, cols) shape to split.
+        block_rows: the number of rows per strip.
+
+    Returns:
+        a list of (row_offset, col_offset, n_rows, n_cols) windows.
+    """
+    return blockWindows(shape, (block_rows, shape[1]))
+
+
+def windowSlices(window: tuple) -> tuple:
+    """Converts a tile window to array slices.
+
+    Args:
+        window: a (row_offset, col_offset, n_rows, n_cols) window.
+
+    Returns:
+        (row slice, column slice) to index a 2D array with.
+    """
+    row, col, n_rows, n_cols = window
+    return slice(row, row + n_rows), slice(col, col + n_cols)
+
+
+class RasterReader:
+    """Class for reading raster windows concurrently from worker threads
+
+    GDAL dataset handles can't be shared across threads, so each thread opens its own
+        handle to the raster on first use.
+
+    Attributes:
+        path: file path to the raster
+    """
+
+    path: str
+
+    def __init__(self, path: str):
+        """Set up a thread-safe raster reader.
+
+        Args:
+            path: file path to the raster.
+        """
+        self.path = path
+        self._local = threading.local()
+        self._datasets = list()
+        self._lock = threading.Lock()
+
+    def read(self, window: tuple) -> np.ndarray:
+        """Reads every band of a raster window.
+
+        Args:
+            window: a (row_offset, col_offset, n_rows, n_cols) window.
+
+        Returns:
+            an array of shape (n_bands, n_rows, n_cols).
+        """
+        from rasterio.windows import Window
+
+        dataset = getattr(self._local, "dataset", None)
+        if dataset is None:
+            import rasterio
+
+            dataset = rasterio.open(self.path)
+            self._local.dataset = dataset
+            with self._lock:
+                self._datasets.append(dataset)
+
+        row, col, n_rows, n_cols = window
+        with profiling.timer("tiles.read"):
+            data = dataset.read(window=Window(col, row, n_cols, n_rows))
+        profiling.count("tiles.bytes_read", data.nbytes)
+        return data
+
+    def close(self) -> None:
+        """Closes every thread's dataset handle"""
+        with self._lock:
+            for dataset in self._datasets:
+                dataset.close()
+            self._datasets.clear()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+def rasterWindows(path: str) -> list:
+    """Gets the internal tile (or strip) windows of a raster, e.g. the tiles of a COG.
+
+    Args:
+        path: file path to the raster.
+
+    Returns:
+        a list of (row_offset, col_offset, n_rows, n_cols) windows.
+    """
+    import rasterio
+
+    with rasterio.open(path) as src:
+        return [
+            (window.row_off, window.col_off, window.height, window.width)
+            for _, window in src.block_windows(1)
+        ]
+
+
+def bandDescriptions(path: str) -> list:
+    """Gets the band names of a raster from its band descriptions.
+
+    Args:
+        path: file path to the raster.
+
+    Returns:
+        a list of band names, or None if any band is unnamed or names are repeated.
+    """
+    import rasterio
+
+    with rasterio.open(path) as src:
+        descriptions = list(src.descriptions)
+    if None in descriptions or len(set(descriptions)) < len(descriptions):
+        return None
+    return descriptions
+
+
+def rasterPaths(output_path: str, dtypes: list) -> dict:
+    """Gets the file path to write each output data type to.
+
+    GeoTIFF bands all share one data type, so outputs with different types are split
+        across rasters named after their type (e.g. scene_int16.tif, scene_float32.tif).
+
+    Args:
+        output_path: the requested output file path.
+        dtypes: the unique output data types, in output order.
+
+    Returns:
+        a dictionary of {data type: file path}.
+    """
+    if len(dtypes) == 1:
+        return {dtypes[0]: output_path}
+
+    root, ext = os.path.splitext(output_path)
+    return {dtype: f"{root}_{dtype.name}{ext}" for dtype in dtypes}
+
+
+def nodataValue(dtype: np.dtype):
+    """Gets the nodata value used to mark masked pixels for an output data type.
+
+    Args:
+        dtype: the output data type.
+
+    Returns:
+        NaN for floats, INT16_NODATA for int16 and None (no nodata) otherwise.
+    """
+    if np.issubdtype(dtype, np.floating):
+        return float("nan")
+    if dtype == np.int16:
+        return INT16_NODATA
+    return None
+
+
+def processRaster(
+    input_path: str,
+    output_path: str,
+    function: Callable,
+    output_names: list,
+    band_names: list = None,
+    windows: list = None,
+    dtype: np.dtype = np.float32,
+    n_threads: int = N_THREADS,
+    max_in_flight: int = TILES_IN_FLIGHT,
+    **profile,
+) -> dict:
+    """Runs a local kernel on a raster one tile at a time, writing a new raster.
+
+    Args:
+        input_path: file path to the input raster (e.g. a GeoTIFF or COG).
+        output_path: file path to write the output GeoTIFF to. if the outputs have
+            different data types, one raster is written per type (see rasterPaths()).
+            only the input's crs, transform and size are copied to the outputs.
+        function: a function called with ({band name: (rows, cols) array}, window)
+            that returns a dictionary of {output name: (rows, cols) array}.
+        output_names: the outputs to write, in output band order.
+        band_names: the names of the input bands. defaults to the raster's band
+            descriptions, raising a ValueError if they are missing or repeated.
+        windows: the (row_offset, col_offset, n_rows, n_cols) windows to process.
+            defaults to the input raster's internal tiles.
+        dtype: the output data type, or a dictionary of {output name: data type}.
+            boolean outputs are written as uint8.
+        n_threads: the number of worker threads.
+        max_in_flight: the maximum number of tiles held in memory at once.
+        **profile: creation options for the output raster (e.g. compress="deflate").
+
+    Returns:
+        a dictionary of {file path: output names written to it}.
+    """
+    import rasterio
+    from rasterio.windows import Window
+
+    with rasterio.open(input_path) as src:
+        if band_names is None:
+            band_names = bandDescriptions(input_path)
+            if band_names is None:
+                raise ValueError(
+                    f"The bands of {input_path} have missing or duplicate "
+                    "descriptions. Pass band_names to name them"
+                )
+        if windows is None:
+            windows = rasterWindows(input_path)
+        # only the georeferencing is kept. the source's nodata, compression and
+        # photometric tags don't apply to the outputs
+        source_profile = dict(
+            crs=src.crs, transform=src.transform, width=src.width, height=src.height
+        )
+
+    if not isinstance(dtype, dict):
+        dtype = {name: dtype for name in output_names}
+    dtypes = dict()
+    for name in output_names:
+        output_dtype = np.dtype(dtype[name])
+        output_dtype = np.dtype(np.uint8) if output_dtype == bool else output_dtype
+        dtypes.setdefault(output_dtype, []).append(name)
+    paths = rasterPaths(output_path, list(dtypes))
+
+    with RasterReader(input_path) as reader, ExitStack() as stack:
+        datasets = dict()
+        for output_dtype, names in dtypes.items():
+            output_profile = source_profile.copy()
+            output_profile.update(
+                driver="GTiff",
+                count=len(names),
+                dtype=output_dtype.name,
+                nodata=nodataValue(output_dtype),
+                **profile,
+            )
+            dst = stack.enter_context(
+                rasterio.open(paths[output_dtype], "w", **output_profile)
+            )
+            dst.descriptions = tuple(names)
+            datasets[output_dtype] = dst
+
+        def processTile(window: tuple) -> dict:
+            tile = dict(zip(band_names, reader.read(window)))
+            products = function(tile, window)
+            stacks = dict()
+            for output_dtype, names in dtypes.items():
+                data = np.stack([products[name] for name in names])
+                stacks[output_dtype] = data.astype(output_dtype)
+            return stacks
+
+        def writeTile(window: tuple, stacks: dict) -> None:
+            row, col, n_rows, n_cols = window
+            for output_dtype, data in stacks.items():
+                with profiling.timer("tiles.write"):
+                    datasets[output_dtype].write(
+                        data, window=Window(col, row, n_cols, n_rows)
+                    )
+                profiling.count("tiles.bytes_written", data.nbytes)
+
+        scheduler = TileScheduler(n_threads, max_in_flight)
+        scheduler.run(processTile, writeTile, windows)
+
+    return {paths[output_dtype]: names for output_dtype, names in dtypes.items()}
@@ -1,16 +1,38 @@
 """Utility functions for working with spectral libraries and earth engine routines."""
 
+import hashlib
 import os
-from copy import deepcopy as copy
+import threading
+import zlib
+from collections import OrderedDict
+from typing import Union
 from warnings import warn
 
 import ee
 import numpy as np
 import spectral
 
-from earthlib.config import collections, endmember_path, metadata
-from earthlib.errors import SensorError
-from earthlib.read import spectralLibrary
+from earthlib import profiling
+from earthlib.config import (
+    BACKEND,
+    BACKENDS,
+    DEVICES,
+    LIBRARY_CACHE_SIZE,
+    N_ITERATIONS,
+    RANDOM_SEED,
+    ROW_BLOCK_SIZE,
+    SRF_N_SIGMA,
+    collections,
+    endmember_path,
+    getMetadata,
+    getTypeIndex,
+)
+from earthlib.errors import BackendError, EndmemberError, SensorError
+from earthlib.read import Spectra, SpectralLibraryWriter, spectralLibrary
+
+# spectral libraries loaded by path, shared by every selectSpectra() call
+_library_cache = OrderedDict()
+_library_lock = threading.Lock()
 
 
 def listSensors() -> list:
@@ -32,10 +54,37 @@ def validateSensor(sensor: str) -> None:
     Raises:
         SensorError: when an invalid sensor name is passed
     """
-    supported = listSensors()
-    if sensor not in supported:
+    if sensor not in collections:
         raise SensorError(
-            f"Invalid sensor: {sensor}. Supported: {', '.join(supported)}"
+            f"Invalid sensor: {sensor}. Supported: {', '.join(listSensors())}"
+        )
+
+
+def validateDevice(device: str) -> None:
+    """Verify a string compute device is valid, raise an error otherwise.
+
+    Args:
+        device: the name of the compute device for local kernels (e.g. "cpu", "gpu").
+
+    Raises:
+        BackendError: when an invalid device name is passed
+    """
+    if device not in DEVICES:
+        raise BackendError(f"Invalid device: {device}. Supported: {', '.join(DEVICES)}")
+
+
+def validateBackend(backend: str) -> None:
+    """Verify a string processing backend is valid, raise an error otherwise.
+
+    Args:
+        backend: the name of the processing backend (e.g. "ee", "local").
+
+    Raises:
+        BackendError: when an invalid backend name is passed
+    """
+    if backend not in BACKENDS:
+        raise BackendError(
+            f"Invalid backend: {backend}. Supported: {', '.join(BACKENDS)}"
         )
 
 
@@ -48,8 +97,7 @@ def listTypes(level: int = 2) -> list:
     Returns:
         classes: a list of spectral data types referenced throughout this package.
     """
-    key = f"LEVEL_{level}"
-    types = list(metadata[key].unique())
+    types = list(getTypeIndex()[level])
     return types
 
 
@@ -62,9 +110,7 @@ def getTypeLevel(Type: str) -> int:
     Returns:
         level: the metadata "level" of the group for subsetting. returns 0 if not found.
     """
-    for i in range(4):
-        level = i + 1
-        available_types = listTypes(level=level)
+    for level, available_types in getTypeIndex().items():
         if Type in available_types:
             return level
 
@@ -107,7 +153,7 @@ def getScaler(sensor: str) -> str:
         scaler: the scale factor to multiply.
     """
     validateSensor(sensor)
-    scaler = copy(collections[sensor]).get("scale")
+    scaler = collections[sensor].get("scale")
     return scaler
 
 
@@ -121,7 +167,7 @@ def getBands(sensor: str) -> list:
         bands: a list of sensor-specific band names.
     """
     validateSensor(sensor)
-    bands = copy(collections[sensor]).get("band_names")
+    bands = list(collections[sensor].get("band_names"))
     return bands
 
 
@@ -135,7 +181,7 @@ def getBandDescriptions(sensor: str) -> list:
         bands: a list of sensor-specific band names.
     """
     validateSensor(sensor)
-    bands = copy(collections[sensor]).get("band_descriptions")
+    bands = list(collections[sensor].get("band_descriptions"))
     return bands
 
 
@@ -165,7 +211,15 @@ def getBandIndices(custom_bands: list, sensor: str) -> list:
     return indices
 
 
-def selectSpectra(Type: str, sensor: str, n: int = 20, bands: list = None) -> list:
+@profiling.timed()
+def selectSpectra(
+    Type: str,
+    sensor: str,
+    n: int = 20,
+    bands: list = None,
+    response: np.ndarray = None,
+    seed: int = RANDOM_SEED,
+) -> list:
     """Subsets the earthlib spectral endmember library.
 
     Selects endmembers from specific class, then resamples the spectra to the wavelengths
@@ -176,21 +230,169 @@ def selectSpectra(Type: str, sensor: str, n: int = 20, bands: list = None) -> li
         sensor: the sensor type to resample wavelengths to.
         n: the number of random spectra to sample. n=0 returns all spectra.
         bands: list of bands to use. Accepts 0-based indices or a list of band names (e.g. ["B2", "B3", "B4"]).
+        response: a custom (n_bands, n_wavelengths) spectral response matrix to resample with
+            (e.g. from tabulatedResponse()). defaults to gaussian responses for the sensor bands.
+        seed: the random seed, or a Generator. the same seed returns the same spectra,
+            and each Type draws from an independent stream.
 
     Returns:
         a list of spectral endmembers resampled to a specific sensor's wavelengths.
     """
     validateSensor(sensor)
+    validateType(Type)
+
+    # get the spectra from just the type passed, resampled to the sensor wavelengths
+    library = getEndmemberLibrary()
+    resampled = library.subset(Type, sensorResponse(sensor, bands, response))
+
+    # subset them further if the n parameter is passed
+    if n > 0:
+        rng = randomGenerator(seed, key=Type)
+        random_indices = rng.integers(len(resampled), size=n)
+        resampled = resampled[random_indices, :]
+
+    return list(resampled)
+
+
+@profiling.timed()
+def sampleEndmembers(
+    Types: list,
+    sensor: str,
+    n: int = N_ITERATIONS,
+    bands: list = None,
+    response: np.ndarray = None,
+    seed: int = RANDOM_SEED,
+    stratify: str = None,
+) -> np.ndarray:
+    """Draws random endmembers for each unmixing iteration from several classes at once.
+
+    Every draw comes from a single counter-based (Philox) generator, so the same seed
+        returns the same endmembers in any process without sharing random state.
+        Stratified sampling cycles through the unique values of a metadata column
+        (e.g. "SOURCE" or "LEVEL_4") so each stratum is drawn at the same rate,
+        then selects a random spectrum within each stratum.
+
+    Args:
+        Types: the type of spectra to select for each class (from earthlib.listTypes()).
+        sensor: the sensor type to resample wavelengths to.
+        n: the number of unmixing iterations to draw endmembers for.
+        bands: list of bands to use. Accepts 0-based indices or a list of band names.
+        response: a custom (n_bands, n_wavelengths) spectral response matrix.
+        seed: the random seed, or a Generator. the same seed returns the same
+            endmembers.
+        stratify: the name of a library metadata column to stratify draws by.
+
+    Returns:
+        a contiguous float array of shape (n, len(Types), n_bands).
+    """
+    validateSensor(sensor)
+    for Type in Types:
+        validateType(Type)
+
+    library = getEndmemberLibrary()
+    response = sensorResponse(sensor, bands, response)
+    subsets = [library.subset(Type, response) for Type in Types]
+
+    rng = randomGenerator(seed)
+    draws = rng.random((n, len(Types)))
+    indices = np.empty((n, len(Types)), dtype=np.intp)
+    if stratify is None:
+        for i, subset in enumerate(subsets):
+            indices[:, i] = (draws[:, i] * len(subset)).astype(np.intp)
+    else:
+        offsets = rng.random(len(Types))
+        for i, Type in enumerate(Types):
+            labels = library.metadata[stratify].values[library.typeIndices(Type)]
+            _, inverse, counts = np.unique(
+                labels, return_inverse=True, return_counts=True
+            )
+
+            # order the class members by stratum, then index within each stratum
+            members = np.argsort(inverse, kind="stable")
+            starts = np.cumsum(counts) - counts
+            strata = (np.arange(n) + int(offsets[i] * len(counts))) % len(counts)
+            within = (draws[:, i] * counts[strata]).astype(np.intp)
+            indices[:, i] = members[starts[strata] + within]
+
+    spectra = np.empty((n, len(Types), response.shape[0]), dtype=np.float64)
+    for i, subset in enumerate(subsets):
+        spectra[:, i] = subset[indices[:, i]]
+
+    return spectra
+
+
+def endmemberArray(spectra: np.ndarray) -> ee.Array:
+    """Converts sampled endmembers to a single earth engine array.
 
-    # get the level of the group selected
-    level = getTypeLevel(Type)
-    if level == 0:
+    Args:
+        spectra: an (n_iterations, n_classes, n_bands) array (from sampleEndmembers()).
+
+    Returns:
+        an ee.Array with the same shape.
+    """
+    return ee.Array(np.asarray(spectra).tolist())
+
+
+def unmixingEndmembers(
+    Types: list,
+    sensor: str,
+    bands: list,
+    n: int = N_ITERATIONS,
+    backend: str = BACKEND,
+    seed: int = RANDOM_SEED,
+) -> Union[ee.Array, np.ndarray]:
+    """Samples endmembers for an unmixing module in the format its backend expects.
+
+    Args:
+        Types: the type of spectra to select for each class (from earthlib.listTypes()).
+        sensor: the name of the sensor (from earthlib.listSensors()).
+        bands: a list of bands to select (from earthlib.getBands(sensor)).
+        n: the number of iterations for unmixing.
+        backend: the processing backend. "local" returns a numpy array.
+        seed: the random seed for endmember selection.
+
+    Returns:
+        the endmembers with shape (n, len(Types), n_bands), as an ee.Array for the
+            "ee" backend or a numpy array for the "local" backend.
+    """
+    spectra = sampleEndmembers(Types, sensor, n, bands, seed=seed)
+    if backend == "local":
+        return spectra
+
+    return endmemberArray(spectra)
+
+
+def validateType(Type: str) -> None:
+    """Verify a spectral type is in the endmember library, raise an error otherwise.
+
+    Args:
+        Type: the type of spectra to select (from earthlib.listTypes()).
+
+    Raises:
+        EndmemberError: when the type is not found at any classification level
+    """
+    if getTypeLevel(Type) == 0:
         raise EndmemberError(
             f"Invalid group parameter: {Type}. Get valid values from earthlib.listTypes()."
         )
 
-    # read the spectral library into memory
-    endmembers = spectralLibrary(endmember_path)
+
+def sensorResponse(
+    sensor: str, bands: list = None, response: np.ndarray = None
+) -> np.ndarray:
+    """Builds the spectral response matrix to resample the library to a sensor's bands.
+
+    Args:
+        sensor: the sensor type to resample wavelengths to.
+        bands: list of bands to use. Accepts 0-based indices or a list of band names.
+        response: a custom (n_bands, n_wavelengths) spectral response matrix.
+            returned as-is if passed.
+
+    Returns:
+        an array of shape (n_bands, n_wavelengths).
+    """
+    if response is not None:
+        return response
 
     # subset to specific bands, if set
     if bands is None:
@@ -199,27 +401,340 @@ def selectSpectra(Type: str, sensor: str, n: int = 20, bands: list = None) -> li
         if type(bands[0]) is str:
             bands = getBandIndices(bands, sensor)
 
-    # create a band resampler for this collection
+    library = getEndmemberLibrary()
     sensor_centers = np.array(collections[sensor]["band_centers"])[bands]
     sensor_fwhm = np.array(collections[sensor]["band_widths"])[bands]
-    resampler = spectral.BandResampler(
-        endmembers.band_centers, sensor_centers, fwhm2=sensor_fwhm
+    return gaussianResponse(library.spectra.band_centers, sensor_centers, sensor_fwhm)
+
+
+def randomGenerator(seed: int = RANDOM_SEED, key: str = None) -> np.random.Generator:
+    """Creates a counter-based random number generator.
+
+    Args:
+        seed: the random seed, or a Generator to return as-is (e.g. to share one
+            stream across calls). None draws a seed from numpy's global random
+            state, so results still follow np.random.seed().
+        key: a name for an independent stream (e.g. a class name), so calls with the
+            same seed but different keys don't return correlated draws.
+
+    Returns:
+        a numpy Generator backed by the Philox bit generator.
+    """
+    if isinstance(seed, np.random.Generator):
+        return seed
+
+    if seed is None:
+        seed = np.random.randint(2**32, dtype=np.uint64)
+    spawn_key = () if key is None else (zlib.crc32(key.encode()),)
+    return np.random.Generator(
+        np.random.Philox(np.random.SeedSequence(int(seed), spawn_key=spawn_key))
     )
 
-    # select the endmembers from just the type passed
-    key = f"LEVEL_{level}"
-    indices = metadata[key] == Type
-    spectra_raw = endmembers.spectra[indices, :]
 
-    # subset them further if the n parameter is passed
-    if n > 0:
-        random_indices = np.random.randint(indices.sum(), size=n)
-        spectra_raw = spectra_raw[random_indices, :]
+def gaussianResponse(
+    wavelengths: np.ndarray,
+    band_centers: np.ndarray,
+    band_widths: np.ndarray,
+    n_sigma: float = SRF_N_SIGMA,
+) -> np.ndarray:
+    """Builds a gaussian spectral response matrix to resample spectra to sensor bands.
+
+    Args:
+        wavelengths: the center wavelength of each band in the source spectra.
+        band_centers: the sensor band center wavelengths (in the same units).
+        band_widths: the sensor band full-width-half-max values.
+        n_sigma: responses beyond this many standard deviations are set to zero.
+            bands narrower than the source wavelength spacing fall back to linear
+            interpolation between the two nearest source wavelengths.
+
+    Returns:
+        response: an array of shape (n_bands, n_wavelengths) with rows that sum to one.
+    """
+    wavelengths = np.asarray(wavelengths, dtype=float)
+    band_centers = np.asarray(band_centers, dtype=float)[:, np.newaxis]
+    sigma = np.asarray(band_widths, dtype=float)[:, np.newaxis] / (
+        2 * np.sqrt(2 * np.log(2))
+    )
+
+    distance = (wavelengths[np.newaxis, :] - band_centers) / sigma
+    response = np.exp(-0.5 * distance**2)
+    response[np.abs(distance) > n_sigma] = 0
+
+    empty = ~response.any(axis=1)
+    if empty.any():
+        response[empty] = interpolationWeights(wavelengths, band_centers[empty, 0])
+
+    return normalizeResponse(response)
+
+
+def interpolationWeights(wavelengths: np.ndarray, centers: np.ndarray) -> np.ndarray:
+    """Builds linear interpolation weights to sample spectra at specific wavelengths.
+
+    Args:
+        wavelengths: the increasing center wavelengths of the source spectra.
+        centers: the wavelengths to interpolate to. values outside the source range
+            take the nearest source wavelength.
+
+    Returns:
+        weights: an array of shape (n_centers, n_wavelengths) with rows that sum to one.
+    """
+    centers = np.clip(centers, wavelengths[0], wavelengths[-1])
+    upper = np.clip(np.searchsorted(wavelengths, centers), 1, len(wavelengths) - 1)
+    lower = upper - 1
+    fraction = (centers - wavelengths[lower]) / (wavelengths[upper] - wavelengths[lower])
+
+    rows = np.arange(len(centers))
+    weights = np.zeros((len(centers), len(wavelengths)))
+    weights[rows, lower] = 1 - fraction
+    weights[rows, upper] += fraction
+    return weights
+
+
+def tabulatedResponse(
+    wavelengths: np.ndarray, response_wavelengths: np.ndarray, responses: np.ndarray
+) -> np.ndarray:
+    """Builds a spectral response matrix from tabulated sensor response functions.
+
+    Args:
+        wavelengths: the center wavelength of each band in the source spectra.
+        response_wavelengths: the increasing wavelengths the responses are tabulated at.
+            either shared by all bands (n_samples,) or per band (n_bands, n_samples).
+        responses: the relative response of each band, shape (n_bands, n_samples).
+
+    Returns:
+        response: an array of shape (n_bands, n_wavelengths) with rows that sum to one.
+    """
+    wavelengths = np.asarray(wavelengths, dtype=float)
+    responses = np.asarray(responses, dtype=float)
+    response_wavelengths = np.broadcast_to(
+        np.asarray(response_wavelengths, dtype=float), responses.shape
+    )
+
+    response = np.array(
+        [
+            np.interp(wavelengths, band_wavelengths, band_response, left=0, right=0)
+            for band_wavelengths, band_response in zip(response_wavelengths, responses)
+        ]
+    )
 
-    # loop through each spectrum and resample to the sensor wavelengths
-    resampled = list()
-    for i in range(spectra_raw.shape[0]):
-        spectrum = resampler(spectra_raw[i, :])
-        resampled.append(spectrum)
+    return normalizeResponse(response)
+
+
+def normalizeResponse(response: np.ndarray) -> np.ndarray:
+    """Scales each spectral response function to sum to one.
+
+    Args:
+        response: an array of shape (n_bands, n_wavelengths).
+
+    Returns:
+        the normalized response. bands with no overlap with the source wavelengths are zero.
+    """
+    totals = response.sum(axis=1, keepdims=True)
+    return np.divide(response, totals, out=np.zeros_like(response), where=totals > 0)
+
+
+def resampleSpectra(
+    spectra: np.ndarray, response: np.ndarray, out: np.ndarray = None
+) -> np.ndarray:
+    """Resamples a block of spectra with a spectral response matrix.
+
+    Only the wavelength range covered by any response function is read, and the
+        product runs as a single multithreaded matrix multiply.
+
+    Args:
+        spectra: an array of shape (n_spectra, n_wavelengths).
+        response: an array of shape (n_bands, n_wavelengths) (e.g. from gaussianResponse()).
+        out: an optional (n_spectra, n_bands) array to write the output to.
+
+    Returns:
+        resampled: an array of shape (n_spectra, n_bands).
+    """
+    covered = np.flatnonzero(response.any(axis=0))
+    if len(covered) == 0:
+        if out is None:
+            out = np.zeros((spectra.shape[0], response.shape[0]))
+        else:
+            out[:] = 0
+        return out
+
+    window = slice(covered[0], covered[-1] + 1)
+    return np.matmul(spectra[:, window], response[:, window].T, out=out)
+
+
+def writeResampledLibraries(
+    spectra: Spectra, outputs: dict, block_size: int = ROW_BLOCK_SIZE
+) -> None:
+    """Writes sensor-resampled copies of a spectral library in a single pass.
+
+    The source spectra are read one row batch at a time, and each batch is resampled
+        and appended to every output file, so peak memory scales with the batch size.
+
+    Args:
+        spectra: the source spectral library.
+        outputs: a dictionary mapping output file paths to sensor names (from earthlib.listSensors()).
+        block_size: the number of spectra to resample per batch.
+    """
+    responses = dict()
+    writers = dict()
+    try:
+        for path, sensor in outputs.items():
+            validateSensor(sensor)
+            sensor_centers = np.array(collections[sensor]["band_centers"])
+            sensor_fwhm = np.array(collections[sensor]["band_widths"])
+            responses[path] = gaussianResponse(
+                spectra.band_centers, sensor_centers, sensor_fwhm
+            )
+            writers[path] = SpectralLibraryWriter(
+                path, sensor_centers, spectra.band_unit
+            )
+
+        n_spectra = spectra.spectra.shape[0]
+        for start in range(0, n_spectra, block_size):
+            batch = spectra.spectra[start : start + block_size]
+            names = spectra.names[start : start + block_size]
+            for path, writer in writers.items():
+                writer.append(resampleSpectra(batch, responses[path]), names)
+
+    finally:
+        for writer in writers.values():
+            writer.close()
+
+
+def getEndmemberLibrary(path: str = endmember_path) -> "EndmemberLibrary":
+    """Returns the process-wide cached copy of a spectral library.
+
+    Args:
+        path: file path to the ENVI spectral library file.
+
+    Returns:
+        an EndmemberLibrary, reloaded only if the file has changed since last read.
+    """
+    key = os.path.realpath(path)
+    mtime = os.path.getmtime(path)
+    with _library_lock:
+        cached = _library_cache.get(key)
+        if cached is not None and cached[0] == mtime:
+            _library_cache.move_to_end(key)
+            profiling.count("utils.library_cache.hits")
+            return cached[1]
+
+    profiling.count("utils.library_cache.misses")
+    library = EndmemberLibrary(path)
+    with _library_lock:
+        # replaces any copy loaded from an older version of the file
+        _library_cache[key] = (mtime, library)
+        _library_cache.move_to_end(key)
+        while len(_library_cache) > LIBRARY_CACHE_SIZE:
+            _library_cache.popitem(last=False)
+
+    return library
+
+
+class EndmemberLibrary:
+    """Class for caching a spectral library and its sensor-resampled views
+
+    Attributes:
+        path: file path to the ENVI spectral library file
+        spectra: the library reflectance data
+        metadata: the per-spectrum class labels (LEVEL_1..LEVEL_4)
+    """
+
+    path: str
+    spectra: Spectra
+    metadata: "pandas.DataFrame"
+
+    def __init__(self, path: str = endmember_path, metadata_frame=None):
+        """Load a spectral library for repeated resampling and subsetting.
+
+        Args:
+            path: file path to the ENVI spectral library file.
+            metadata_frame: a pandas DataFrame with the class labels for each spectrum.
+                read from the .csv sidecar file if not passed (the package metadata for
+                the default library).
+        """
+        if metadata_frame is None:
+            if os.path.realpath(path) == os.path.realpath(endmember_path):
+                metadata_frame = getMetadata()
+            else:
+                import pandas as pd
+
+                metadata_frame = pd.read_csv(os.path.splitext(path)[0] + ".csv")
+
+        self.path = path
+        self.spectra = spectralLibrary(path)
+        self.metadata = metadata_frame
+        self._resampled = dict()
+        self._subsets = dict()
+        self._lock = threading.Lock()
+
+    def resample(self, response: np.ndarray) -> np.ndarray:
+        """Resamples the full library with a spectral response matrix, computed on first use.
+
+        Args:
+            response: an array of shape (n_bands, n_wavelengths) (e.g. from gaussianResponse()).
+
+        Returns:
+            a contiguous, read-only array of shape (n_spectra, n_bands).
+        """
+        key = self._key(response)
+        with self._lock:
+            if key in self._resampled:
+                profiling.count("utils.resample_cache.hits")
+                return self._resampled[key]
+
+        profiling.count("utils.resample_cache.misses")
+        with profiling.timer("utils.resampleSpectra"):
+            resampled = resampleSpectra(self.spectra.spectra, response)
+        resampled.flags.writeable = False
+
+        with self._lock:
+            self._resampled[key] = resampled
+
+        return resampled
+
+    def subset(self, Type: str, response: np.ndarray) -> np.ndarray:
+        """Returns the resampled spectra for a single class.
+
+        Args:
+            Type: the type of spectra to select (from the LEVEL_1..LEVEL_4 metadata).
+            response: an array of shape (n_bands, n_wavelengths) (e.g. from gaussianResponse()).
+
+        Returns:
+            a contiguous, read-only array of shape (n_type_spectra, n_bands).
+        """
+        key = (Type,) + self._key(response)
+        with self._lock:
+            if key in self._subsets:
+                return self._subsets[key]
+
+        resampled = self.resample(response)
+        subset = np.ascontiguousarray(resampled[self.typeIndices(Type)])
+        subset.flags.writeable = False
+
+        with self._lock:
+            self._subsets[key] = subset
+
+        return subset
+
+    def typeIndices(self, Type: str) -> np.ndarray:
+        """Returns the row indices of the library spectra labeled as a specific type.
+
+        Args:
+            Type: the type of spectra to select (from the LEVEL_1..LEVEL_4 metadata).
+
+        Returns:
+            an integer array of row indices.
+        """
+        for level in range(1, 5):
+            labels = self.metadata[f"LEVEL_{level}"].values
+            if Type in labels:
+                return np.flatnonzero(labels == Type)
+
+        raise EndmemberError(
+            f"Invalid group parameter: {Type}. Not found in {self.path}"
+        )
 
-    return resampled
+    def _key(self, response: np.ndarray) -> tuple:
+        """Create a hashable cache key from a spectral response matrix"""
+        response = np.ascontiguousarray(response, dtype=float)
+        return (response.shape, hashlib.sha1(response.tobytes()).hexdigest())
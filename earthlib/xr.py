@@ -0,0 +1,321 @@
+"""An xarray accessor for running the local kernels over chunked (dask) arrays.
+
+Importing this module registers a `.earthlib` accessor on xarray DataArrays with a
+    "band" dimension labeled by sensor band names, e.g. (time, band, y, x) stacks:
+
+    import earthlib.xr
+    nirv = stack.earthlib.scale("Landsat8").earthlib.nirv("Landsat8")
+
+Each method maps a local kernel over the dask chunks of the array, so computations run
+    on as many workers as the dask scheduler provides. The kernels are numpy routines
+    that release the GIL, and the endmember factorization and BRDF kernel caches are
+    module-level, so they are shared by every task running in a worker process.
+    Requires xarray and dask (`pip install earthlib[xarray]`).
+"""
+
+import math
+
+import numpy as np
+import xarray as xr
+
+from earthlib import BRDFCorrect, CloudMask, NIRv, Scale
+from earthlib.config import N_ITERATIONS, RANDOM_SEED, RMSE, SHADE_NORMALIZE
+from earthlib.Unmix import fractionalCoverLocal
+from earthlib.utils import getBands
+
+BAND = "band"
+ENDMEMBER = "endmember"
+
+
+@xr.register_dataarray_accessor("earthlib")
+class EarthlibAccessor:
+    """Class for running earthlib kernels on xarray DataArrays
+
+    Attributes:
+        band_dim: the name of the band dimension
+        y_dim: the name of the row dimension
+        x_dim: the name of the column dimension
+    """
+
+    band_dim: str
+    y_dim: str
+    x_dim: str
+
+    def __init__(self, obj: xr.DataArray):
+        self._obj = obj
+        self.band_dim = BAND
+        self.y_dim = "y"
+        self.x_dim = "x"
+
+    def scale(self, sensor: str, dtype: np.dtype = np.float32) -> xr.DataArray:
+        """Rescales sensor DNs to reflectance, mirroring Scale.bySensor().
+
+        Args:
+            sensor: the name of the sensor (from earthlib.listSensors()).
+            dtype: the output type (see Scale.scaleLocal()).
+
+        Returns:
+            the scaled reflectance bands.
+        """
+        scale, offset = Scale.getScaleParams(sensor)
+        reflectance = self._obj.sel({self.band_dim: getBands(sensor)})
+        return xr.apply_ufunc(
+            Scale.scaleLocal,
+            reflectance,
+            kwargs={"scale": scale, "offset": offset, "dtype": dtype},
+            dask="parallelized",
+            output_dtypes=[np.dtype(dtype)],
+            keep_attrs=True,
+        )
+
+    def cloudMask(self, sensor: str) -> xr.DataArray:
+        """Computes a QA band cloud mask, mirroring CloudMask.qaMaskLocal().
+
+        Args:
+            sensor: the sensor name (e.g. "Landsat8") or a config.QA_RULES key.
+
+        Returns:
+            a boolean mask without the band dimension (True for clear pixels).
+        """
+        names = [band for band, *_ in CloudMask.getRules(sensor)]
+        qa = self._obj.sel({self.band_dim: list(dict.fromkeys(names))})
+
+        def maskChunk(array):
+            bands = pixelBands(array, qa[self.band_dim].values)
+            mask = CloudMask.qaMaskLocal(bands, sensor, pack=False, n_threads=1)
+            return mask.reshape(array.shape[:-1])
+
+        return self.pixelMap(maskChunk, qa, bool)
+
+    def opening(
+        self, iterations: int = 3, radius: int = None, kernel: str = "circle"
+    ) -> xr.DataArray:
+        """Applies a morphological opening to a boolean mask, mirroring Opening().
+
+        Chunks are extended with halo pixels from their neighbors (the erosion plus
+            the dilation radius), so the results match running on the full array.
+            Chunks narrower than the halo are merged with their neighbors first.
+
+        Args:
+            iterations: the number of erode/dilate iterations (see openingLocal()).
+            radius: the total erosion/dilation radius in pixels.
+            kernel: the kernel shape. supported values are "circle" and "square".
+
+        Returns:
+            the opened mask.
+        """
+        mask = self._obj.transpose(..., self.y_dim, self.x_dim)
+        if radius is None:
+            radius = iterations * iterations
+
+        def openChunk(array):
+            leading = array.shape[:-2]
+            opened = np.empty(array.shape, dtype=bool)
+            for index in np.ndindex(*leading):
+                opened[index] = CloudMask.openingLocal(
+                    array[index], radius=radius, kernel=kernel
+                )
+            return opened
+
+        if mask.chunks is None:
+            return mask.copy(data=openChunk(mask.values))
+
+        # halos can't reach past the neighboring chunk, so small chunks are merged
+        halo = math.ceil(2 * radius)
+        dims = (self.y_dim, self.x_dim)
+        mask = mask.chunk({dim: haloChunks(mask.chunksizes[dim], halo) for dim in dims})
+        depth = {
+            mask.ndim - 2 + i: halo if len(mask.chunksizes[dim]) > 1 else 0
+            for i, dim in enumerate(dims)
+        }
+        opened = mask.data.map_overlap(
+            openChunk, depth=depth, boundary="none", dtype=bool
+        )
+        return mask.copy(data=opened)
+
+    def nirv(self, sensor: str) -> xr.DataArray:
+        """Computes NIRv from scaled reflectance, mirroring NIRv.bySensor().
+
+        Args:
+            sensor: the name of the sensor (from earthlib.listSensors()).
+
+        Returns:
+            a float32 NIRv array without the band dimension.
+        """
+        red, nir = NIRv.getNIRvBands(sensor)
+        return xr.apply_ufunc(
+            NIRv.NIRvLocal,
+            self._obj.sel({self.band_dim: red}, drop=True),
+            self._obj.sel({self.band_dim: nir}, drop=True),
+            dask="parallelized",
+            output_dtypes=[np.float32],
+        )
+
+    def brdfCorrect(
+        self, sensor: str, geometry: dict, scaleFactor: float = 1
+    ) -> xr.DataArray:
+        """Applies BRDF corrections to a single scene, mirroring BRDFCorrect.bySensor().
+
+        The coarse kernel grids are computed once for the scene, and each chunk is
+            corrected with the rows it covers. Chunks span the full scene width.
+
+        Args:
+            sensor: the name of the sensor (from earthlib.listSensors()).
+            geometry: keyword arguments for BRDFCorrect.kernelGrids() with "lon", "lat",
+                "time_start" and "corners" keys.
+            scaleFactor: a scaling factor to tune the volumetric scattering adjustment.
+
+        Returns:
+            the bands with BRDF coefficients, corrected as float32.
+        """
+        coefficients = BRDFCorrect.getCoefficients(sensor)
+        names = [name for name in getBands(sensor) if name in coefficients]
+        bands = self._obj.sel({self.band_dim: names})
+        if bands.chunks is not None:
+            bands = bands.chunk({self.band_dim: -1, self.x_dim: -1})
+
+        shape = (bands.sizes[self.y_dim], bands.sizes[self.x_dim])
+        kernels = BRDFCorrect.kernelGrids(shape=shape, **geometry)
+        rows = xr.DataArray(
+            np.arange(shape[0]),
+            dims=self.y_dim,
+            coords={self.y_dim: bands[self.y_dim]},
+        )
+        if bands.chunks is not None:
+            rows = rows.chunk({self.y_dim: bands.chunksizes[self.y_dim]})
+
+        band_dim = self.band_dim
+
+        def correctChunk(block: xr.DataArray, rows: xr.DataArray) -> xr.DataArray:
+            ordered = block.transpose(band_dim, ...)
+            corrected = BRDFCorrect.correctRows(
+                dict(zip(names, ordered.values)),
+                kernels,
+                coefficients,
+                scaleFactor,
+                int(rows.values[0]),
+            )
+            stacked = np.stack([corrected[name] for name in names])
+            return ordered.copy(data=stacked).transpose(*block.dims)
+
+        template = bands.astype(np.float32)
+        return xr.map_blocks(correctChunk, bands, args=[rows], template=template)
+
+    def unmix(
+        self,
+        sensor: str,
+        unmixer,
+        n: int = N_ITERATIONS,
+        shade_normalize: bool = SHADE_NORMALIZE,
+        seed: int = RANDOM_SEED,
+    ) -> xr.DataArray:
+        """Unmixes scaled reflectance, mirroring Unmix.fractionalCoverLocal().
+
+        Endmembers are sampled once and shared by all chunks, so every chunk (and
+            every worker) unmixes with the same draws.
+
+        Args:
+            sensor: the name of the sensor (from earthlib.listSensors()).
+            unmixer: the unmixing module (e.g. earthlib.SoilPVNPV).
+            n: the number of unmixing iterations.
+            shade_normalize: apply shade normalization during unmixing.
+            seed: the random seed for endmember selection.
+
+        Returns:
+            the fractional cover of each class and the RMSE, along an "endmember"
+                dimension that replaces the band dimension.
+        """
+        bands = getBands(sensor)
+        endmembers = unmixer.getEndmembers(sensor, bands, n, "local", seed=seed)
+        names = unmixer.ENDMEMBER_NAMES + [RMSE]
+        reflectance = self.bandChunks(self._obj.sel({self.band_dim: bands}))
+
+        def unmixChunk(array):
+            unmixed = fractionalCoverLocal(
+                np.moveaxis(array, -1, 0),
+                endmembers,
+                shade_normalize=shade_normalize,
+                n_threads=1,
+            )
+            return np.moveaxis(unmixed, 0, -1)
+
+        unmixed = xr.apply_ufunc(
+            unmixChunk,
+            reflectance,
+            input_core_dims=[[self.band_dim]],
+            output_core_dims=[[ENDMEMBER]],
+            dask="parallelized",
+            output_dtypes=[np.float32],
+            dask_gufunc_kwargs={"output_sizes": {ENDMEMBER: len(names)}},
+        )
+        return unmixed.assign_coords({ENDMEMBER: names})
+
+    def pixelMap(
+        self, function, bands: xr.DataArray, dtype: np.dtype
+    ) -> xr.DataArray:
+        """Maps a per-pixel kernel over the chunks of a banded array.
+
+        Args:
+            function: a function of a (..., n_bands) array returning a (...) array.
+            bands: the input bands.
+            dtype: the output type.
+
+        Returns:
+            the kernel outputs without the band dimension.
+        """
+        return xr.apply_ufunc(
+            function,
+            self.bandChunks(bands),
+            input_core_dims=[[self.band_dim]],
+            dask="parallelized",
+            output_dtypes=[np.dtype(dtype)],
+        )
+
+    def bandChunks(self, bands: xr.DataArray) -> xr.DataArray:
+        """Merges the band chunks of a dask array, which per-pixel kernels need whole.
+
+        Args:
+            bands: the input bands.
+
+        Returns:
+            the bands with a single chunk along the band dimension.
+        """
+        if bands.chunks is None:
+            return bands
+        return bands.chunk({self.band_dim: -1})
+
+
+def pixelBands(array: np.ndarray, names: list) -> dict:
+    """Splits a (..., n_bands) chunk into 2d arrays for the per-pixel local kernels.
+
+    Args:
+        array: an array with bands along the last axis.
+        names: the name of each band.
+
+    Returns:
+        a dictionary of {band name: (1, n_pixels) array}.
+    """
+    planes = np.ascontiguousarray(np.moveaxis(array, -1, 0))
+    return {name: plane.reshape(1, -1) for name, plane in zip(names, planes)}
+
+
+def haloChunks(chunks: tuple, halo: int) -> tuple:
+    """Merges chunks along a dimension so each one is at least as wide as the halo.
+
+    Args:
+        chunks: the chunk sizes along the dimension.
+        halo: the number of overlapping pixels taken from each neighbor.
+
+    Returns:
+        the new chunk sizes, or the original ones if none were too small.
+    """
+    if min(chunks) >= halo:
+        return tuple(chunks)
+    size = max(halo, max(chunks))
+    merged = [size] * (sum(chunks) // size)
+    remainder = sum(chunks) % size
+    if merged and remainder < halo:
+        merged[-1] += remainder
+    elif remainder:
+        merged.append(remainder)
+    return tuple(merged)
@@ -36,6 +36,12 @@ setup_args = {
         )
     ],
     "install_requires": requirements,
+    "extras_require": {
+        "arrow": ["pyarrow>=8.0"],
+        "gpu": ["cupy-cuda12x"],
+        "raster": ["rasterio>=1.3"],
+        "xarray": ["xarray>=0.20", "dask[array]>=2022.1"],
+    },
     "python_requires": ">=3.4",
     "classifiers": [
         "Programming Language :: Python :: 3",
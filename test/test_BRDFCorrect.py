@@ -0,0 +1,56 @@
+import numpy as np
+
+from earthlib import BRDFCorrect
+
+
+def test_bilinearUpsample():
+    rows = BRDFCorrect.gridIndices(100, 32)
+    cols = BRDFCorrect.gridIndices(50, 32)
+    assert rows[-1] == 99 and cols[-1] == 49
+
+    # a plane is reproduced exactly by bilinear interpolation
+    grid = rows[:, np.newaxis] * 2.0 + cols[np.newaxis, :]
+    full = BRDFCorrect.bilinearUpsample(grid, rows, cols, np.arange(100), np.arange(50))
+    expected = np.arange(100)[:, np.newaxis] * 2.0 + np.arange(50)[np.newaxis, :]
+    assert np.allclose(full, expected, atol=1e-3)
+
+
+def test_brdfCorrectLocal():
+    shape = (64, 48)
+    corners = BRDFCorrect.footprintCorners(
+        [(-120.2, 37.1), (-118.0, 36.7), (-118.4, 35.0), (-120.6, 35.4)]
+    )
+    lon = np.linspace(-120.4, -118.2, shape[1])[np.newaxis, :]
+    lat = np.linspace(36.9, 35.2, shape[0])[:, np.newaxis]
+    time_start = 1593619200000  # 2020-07-01 16:00 UTC
+    bands = {
+        "B4": np.full(shape, 1000, dtype=np.int16),
+        "QA": np.ones(shape, dtype=np.uint16),
+    }
+    corrected = BRDFCorrect.brdfCorrectLocal(
+        bands,
+        lon,
+        lat,
+        time_start,
+        corners,
+        BRDFCorrect.getCoefficients("Sentinel2"),
+        block_rows=16,
+    )
+    assert corrected["B4"].dtype == np.int16
+    assert corrected["QA"] is bands["QA"]
+    assert np.all(np.abs(corrected["B4"] - 1000) < 300)
+    assert not np.all(corrected["B4"] == 1000)
+
+    # kernels are reused across calls on the same scene geometry
+    kernels = BRDFCorrect.kernelGrids(lon, lat, time_start, corners, shape)
+    assert BRDFCorrect.kernelGrids(lon, lat, time_start, corners, shape) is kernels
+    BRDFCorrect.clearKernelCache()
+    assert BRDFCorrect.kernelGrids(lon, lat, time_start, corners, shape) is not kernels
+
+
+def test_footprintCenterLat():
+    # a skewed footprint, where the mean corner latitude is off the bounds center
+    corners = BRDFCorrect.footprintCorners(
+        [(-120.2, 37.1), (-118.0, 37.0), (-118.4, 35.0), (-120.6, 36.9)]
+    )
+    assert np.isclose(BRDFCorrect.footprintCenterLat(corners), 36.05)
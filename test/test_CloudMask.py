@@ -0,0 +1,55 @@
+import numpy as np
+
+from earthlib import CloudMask
+
+
+def test_qaMaskLocal():
+    rng = np.random.default_rng(0)
+    shape = (37, 21)
+    qa = rng.integers(0, 1 << 16, size=shape, dtype=np.uint16)
+    bands = {"state_1km": qa}
+
+    # reference decoding, one rule at a time
+    expected = np.ones(shape, dtype=bool)
+    for _, fromBit, toBit, comparison, value in CloudMask.getRules("MODIS"):
+        field = (qa >> fromBit) & ((1 << (toBit - fromBit + 1)) - 1)
+        expected &= CloudMask.COMPARISONS[comparison](field, value)
+
+    mask = CloudMask.qaMaskLocal(bands, "MODIS", pack=False, block_rows=8)
+    assert np.array_equal(mask, expected)
+
+    packed = CloudMask.qaMaskLocal(bands, "MODIS", block_rows=8)
+    assert packed.shape == (37, 3)
+    assert np.array_equal(CloudMask.unpackMask(packed, shape[1]), expected)
+
+    bands = {
+        "QA_PIXEL": np.array([[0, 1 << 3, 1 << 6]], dtype=np.uint16),
+        "QA_RADSAT": np.array([[0, 0, 1]], dtype=np.uint16),
+    }
+    mask = CloudMask.qaMaskLocal(bands, "Landsat8", pack=False)
+    assert mask.tolist() == [[True, False, False]]
+
+
+def test_openingLocal():
+    rng = np.random.default_rng(0)
+    mask = rng.uniform(size=(30, 40)) > 0.2
+
+    # square erosion matches a brute force focal minimum
+    eroded = CloudMask.erodeLocal(mask, 2, kernel="square")
+    padded = np.pad(mask, 2, constant_values=True)
+    expected = np.ones_like(mask)
+    for i in range(5):
+        for j in range(5):
+            expected &= padded[i : i + 30, j : j + 40]
+    assert np.array_equal(eroded, expected)
+
+    # opening removes features smaller than the kernel and keeps larger ones
+    mask = np.zeros((60, 60), dtype=bool)
+    mask[5:8, 5:8] = True
+    mask[20:50, 20:50] = True
+    opened = CloudMask.openingLocal(mask, radius=4)
+    assert not opened[5:8, 5:8].any()
+    assert opened[25:45, 25:45].all()
+
+    packed = CloudMask.openingLocal(np.packbits(mask, axis=-1), radius=4, n_cols=60)
+    assert np.array_equal(CloudMask.unpackMask(packed, 60), opened)
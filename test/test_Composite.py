@@ -0,0 +1,51 @@
+import numpy as np
+import pytest
+
+from earthlib import Composite
+
+
+def test_Compositor():
+    rng = np.random.default_rng(0)
+    shape = (2, 6, 5)
+    stack = rng.uniform(0, 1, size=(15,) + shape)
+    masks = rng.random((15,) + shape[1:]) > 0.2
+    stack[3, 0, 0, 0] = np.nan
+
+    compositor = Composite.Compositor(shape, bins=200)
+    compositor.addAll((values, mask) for values, mask in zip(stack, masks))
+
+    valid = masks[:, np.newaxis] & ~np.isnan(stack)
+    masked = np.where(valid, stack, np.nan)
+    assert np.array_equal(compositor.count(), valid.sum(axis=0))
+    assert np.allclose(compositor.mean(), np.nanmean(masked, axis=0), atol=1e-6)
+
+    # half of the observations are on either side of the median, within a bin width
+    median = compositor.median()
+    count = valid.sum(axis=0)
+    assert ((masked < median - 1 / 200).sum(axis=0) <= count / 2).all()
+    assert ((masked <= median + 1 / 200).sum(axis=0) >= count / 2).all()
+
+    rmse = np.full(shape[1:], 0.1)
+    weighted = Composite.composite([(stack[0], None, rmse)], shape)
+    assert np.allclose(weighted["weighted_mean"], stack[0])
+    assert "clipped" not in weighted
+
+    # out of range values land in the edge bins and are counted as clipped
+    outside = Composite.Compositor((1, 3))
+    outside.add(np.array([[-0.5, 0.5, 1.5]]))
+    assert outside.clipped().tolist() == [[1, 0, 1]]
+    median = outside.result()["p50"][0]
+    assert median[0] < 1 / 64 and median[2] > 63 / 64
+
+
+def test_Compositor_saturation():
+    compositor = Composite.Compositor((1, 2))
+    compositor._histogram[0] = np.iinfo(np.uint16).max
+    compositor._n_images = np.iinfo(np.uint16).max
+
+    # full bins raise instead of wrapping around, and nothing is added
+    with pytest.raises(ValueError):
+        compositor.add(np.array([[0.0, 0.5]]))
+    assert compositor.count().tolist() == [[0, 0]]
+    compositor.add(np.array([[0.5, 0.5]]))
+    assert compositor.count().tolist() == [[1, 1]]
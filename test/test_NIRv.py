@@ -0,0 +1,32 @@
+import numpy as np
+
+from earthlib import NIRv
+
+
+def test_spectralIndicesLocal():
+    rng = np.random.default_rng(0)
+    shape = (9, 7)
+    bands = {
+        name: rng.uniform(0.01, 0.5, size=shape).astype(np.float32)
+        for name in ["SR_B2", "SR_B3", "SR_B4", "SR_B5", "SR_B6", "SR_B7"]
+    }
+    red, nir, swir2 = bands["SR_B4"], bands["SR_B5"], bands["SR_B7"]
+
+    indices = NIRv.spectralIndicesLocal(
+        bands, "Landsat8", ["NIRv", "NDVI", "NBR"], block_rows=4
+    )
+    assert np.allclose(indices["NIRv"], NIRv.NIRvLocal(red, nir), atol=1e-6)
+    assert np.allclose(indices["NDVI"], (nir - red) / (nir + red), atol=1e-6)
+    assert np.allclose(indices["NBR"], (nir - swir2) / (nir + swir2), atol=1e-6)
+
+    # shared subexpressions are only computed once
+    program, outputs = NIRv.compileIndices(["NIRv", "NDVI"])
+    assert len(program) == len(set(program))
+    assert outputs["NDVI"] < outputs["NIRv"]
+
+
+def test_getIndexBands():
+    roles = NIRv.getIndexBands("ASTER")
+    assert roles["nir"] == "B3N"
+    assert roles["swir1"] == "B04" and roles["swir2"] == "B06"
+    assert NIRv.getIndexBands("VIIRS")["swir1"] == "M10"
@@ -0,0 +1,29 @@
+import numpy as np
+import pytest
+
+from earthlib import Scale
+from earthlib.config import INT16_NODATA
+
+
+def test_scaleLocal_int16():
+    scale, offset = Scale.getScaleParams("Landsat8")
+    dn = np.arange(0, 65536, 257, dtype=np.uint16)
+    expected = np.clip(np.rint((dn * scale + offset) * 10000), -32767, 32767)
+    scaled = Scale.scaleLocal(dn, scale, offset, dtype=np.int16)
+    assert np.abs(scaled - expected).max() <= 1
+
+    # buffer protocol inputs take the same integer path
+    buffered = Scale.scaleLocal(memoryview(dn), scale, offset, dtype=np.int16)
+    assert np.array_equal(buffered, scaled)
+
+    # non-finite floats are flagged as nodata instead of wrapping around
+    values = np.array([0.5, np.nan, np.inf, -np.inf], dtype=np.float32)
+    scaled = Scale.scaleLocal(values, dtype=np.int16)
+    assert scaled.tolist() == [5000] + [INT16_NODATA] * 3
+
+    # nodata is converted back to NaN, so it never reaches NIRv or unmixing as data
+    reflectance = Scale.toReflectance(scaled)
+    assert reflectance[0] == np.float32(0.5) and np.isnan(reflectance[1:]).all()
+
+    with pytest.raises(ValueError):
+        Scale.fixedPointParams(1e3, 0, 0xFFFF)
@@ -0,0 +1,44 @@
+import numpy as np
+
+from earthlib import ThresholdMask
+from earthlib.config import THRESHOLD_TESTS
+
+
+def test_thresholdMaskLocal():
+    rng = np.random.default_rng(0)
+    shape = (25, 10)
+    bands = {
+        f"SR_B{i}": rng.uniform(0, 0.5, size=shape).astype(np.float32)
+        for i in range(1, 8)
+    }
+
+    # reference implementation stacking every test result
+    results = list()
+    for conditions in THRESHOLD_TESTS["Landsat8"]["tests"]:
+        passed = np.ones(shape, dtype=bool)
+        for band, comparison, value in conditions:
+            if "/" in band:
+                numerator, denominator = band.split("/")
+                data = bands[numerator] / bands[denominator]
+            else:
+                data = bands[band]
+            passed &= ThresholdMask.COMPARISONS[comparison](data, value)
+        results.append(passed)
+    expected = np.mean(results, axis=0) < 0.4
+
+    mask = ThresholdMask.thresholdMaskLocal(bands, "Landsat8", block_rows=7)
+    assert np.array_equal(mask, expected)
+    assert mask.any() and not mask.all()
+
+
+def test_thresholdMaskLocal_boundary(monkeypatch):
+    # one test passed per unit of "b", so a pixel of 7 has a probability of 7 / 25
+    tests = [[("b", "gt", i)] for i in range(25)]
+    rules = {"tests": tests, "probability_threshold": 0.28}
+    monkeypatch.setitem(THRESHOLD_TESTS, "boundary", rules)
+    assert ThresholdMask.countLimit(0.28, 25) == 7
+    assert ThresholdMask.countLimit(0.3, 10) == 3
+
+    bands = {"b": np.array([[6, 7, 8]], dtype=np.float32)}
+    mask = ThresholdMask.thresholdMaskLocal(bands, "boundary")
+    assert mask.tolist() == [[True, False, False]]
@@ -0,0 +1,54 @@
+import numpy as np
+import pytest
+
+from earthlib import Unmix
+
+
+def test_fractionalCoverLocal():
+    rng = np.random.default_rng(0)
+    n_classes, n_bands, n_iterations = 3, 6, 3
+    spectra = rng.uniform(0.05, 0.6, size=(n_classes, n_bands))
+    endmembers = np.repeat(spectra[np.newaxis], n_iterations, axis=0)
+
+    # build shaded mixtures of known fractions
+    truth = rng.dirichlet(np.ones(n_classes), size=(4, 5)).transpose(2, 0, 1)
+    brightness = rng.uniform(0.5, 1, size=(4, 5))
+    array = np.einsum("kb,kij->bij", spectra, truth) * brightness
+    array += rng.normal(0, 1e-4, size=array.shape)
+
+    unmixed = Unmix.fractionalCoverLocal(array, endmembers, block_size=7)
+    assert unmixed.shape == (n_classes + 1, 4, 5)
+    assert np.allclose(unmixed[:n_classes], truth, atol=1e-2)
+    assert (unmixed[:n_classes] >= 0).all()
+    assert (unmixed[-1] < 1e-2).all()
+
+    mask = np.zeros((4, 5), dtype=bool)
+    mask[1:3, ::2] = True
+    masked = Unmix.fractionalCoverLocal(array, endmembers, mask=mask, block_size=4)
+    assert np.isnan(masked[:, ~mask]).all()
+    assert np.allclose(masked[:, mask], unmixed[:, mask])
+
+
+def test_fractionalCoverLocal_gpu():
+    cupy = pytest.importorskip("cupy")
+    if cupy.cuda.runtime.getDeviceCount() == 0:
+        pytest.skip("no gpu available")
+
+    rng = np.random.default_rng(0)
+    endmembers = rng.uniform(0.05, 0.6, size=(4, 3, 6))
+    array = rng.uniform(0.05, 0.6, size=(6, 9, 7))
+    cpu = Unmix.fractionalCoverLocal(array, endmembers, block_size=16)
+    gpu = Unmix.fractionalCoverLocal(array, endmembers, device="gpu")
+    assert np.allclose(cpu, gpu, atol=1e-5, equal_nan=True)
+
+
+def test_fractionalCoverLocal_single():
+    rng = np.random.default_rng(0)
+    endmembers = rng.uniform(0.05, 0.6, size=(1, 3, 6))
+    array = rng.uniform(0.05, 0.6, size=(6, 4, 5))
+
+    # a single draw is returned unweighted instead of dividing by n - 1 = 0
+    single = Unmix.fractionalCoverLocal(array, endmembers)
+    repeated = Unmix.fractionalCoverLocal(array, np.repeat(endmembers, 2, axis=0))
+    assert np.isfinite(single).all()
+    assert np.allclose(single, repeated)
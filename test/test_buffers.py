@@ -0,0 +1,31 @@
+import numpy as np
+import pytest
+
+from earthlib import NIRv, buffers
+
+
+def test_asArray():
+    array = np.arange(12, dtype=np.float32).reshape(3, 4)
+    assert np.shares_memory(buffers.asArray(memoryview(array)), array)
+
+    bands = buffers.asArrays({"b1": array.ravel()}, shape=(3, 4))
+    assert bands["b1"].shape == (3, 4)
+    assert np.shares_memory(bands["b1"], array)
+
+
+def test_outputArray():
+    out = np.empty((2, 3), dtype=np.float32)
+    assert buffers.outputArray(out, (2, 3), np.float32) is out
+    with pytest.raises(ValueError):
+        buffers.outputArray(out, (2, 3), np.float64)
+
+
+def test_NIRvLocal_out():
+    rng = np.random.default_rng(0)
+    red = rng.uniform(0.05, 0.2, size=(4, 5)).astype(np.float32)
+    nir = rng.uniform(0.2, 0.5, size=(4, 5)).astype(np.float32)
+    expected = NIRv.NIRvLocal(red, nir)
+
+    result = NIRv.NIRvLocal(red, nir, out=nir)
+    assert result is nir
+    assert np.allclose(result, expected)
@@ -0,0 +1,142 @@
+import numpy as np
+import pytest
+
+from earthlib import BRDFCorrect, Scale, SoilPVNPV
+from earthlib.pipeline import Pipeline
+
+
+def test_Pipeline_local():
+    rng = np.random.default_rng(0)
+    shape = (20, 12)
+    bands = {
+        name: rng.integers(8000, 20000, size=shape, dtype=np.uint16)
+        for name in ["SR_B2", "SR_B3", "SR_B4", "SR_B5", "SR_B6", "SR_B7"]
+    }
+    bands["QA_PIXEL"] = np.zeros(shape, dtype=np.uint16)
+    bands["QA_PIXEL"][:5] = 1 << 3
+    bands["QA_RADSAT"] = np.zeros(shape, dtype=np.uint16)
+
+    pipeline = Pipeline(
+        "Landsat8", ["nirv", "scale", "cloudmask"], backend="local", unmixer=SoilPVNPV
+    )
+    assert pipeline.stages == ["cloudmask", "scale", "nirv"]
+
+    outputs = pipeline(bands, block_rows=6)
+    assert set(outputs) == {"NIRv", "mask"}
+    assert not outputs["mask"][:5].any() and outputs["mask"][5:].all()
+    assert np.isnan(outputs["NIRv"][:5]).all()
+
+    red = bands["SR_B4"][5:] * 2.75e-05 - 0.2
+    nir = bands["SR_B5"][5:] * 2.75e-05 - 0.2
+    expected = ((nir - red) / (nir + red) - 0.08) * nir
+    assert np.allclose(outputs["NIRv"][5:], expected, atol=1e-5)
+
+    stages = ["cloudmask", "scale", "unmix"]
+    pipeline = Pipeline("Landsat8", stages, "local", SoilPVNPV, n=2)
+    outputs = pipeline(bands, block_rows=6)
+    assert np.isnan(outputs["Soil"][:5]).all()
+    assert np.isfinite(outputs["RMSE"][5:]).all()
+
+
+def test_Pipeline_int16():
+    rng = np.random.default_rng(0)
+    shape = (8, 5)
+    bands = {
+        name: rng.integers(8000, 20000, size=shape, dtype=np.uint16)
+        for name in ["SR_B2", "SR_B3", "SR_B4", "SR_B5", "SR_B6", "SR_B7"]
+    }
+
+    stages = ["scale", "nirv"]
+    outputs = ["SR_B4", "NIRv"]
+    full = Pipeline("Landsat8", stages, "local").run(bands, outputs=outputs)
+    reduced = Pipeline("Landsat8", stages, "local", dtype=np.int16).run(
+        bands, outputs=outputs
+    )
+    assert reduced["SR_B4"].dtype == np.int16
+    assert np.allclose(reduced["SR_B4"] / 10000, full["SR_B4"], atol=2e-4)
+    assert np.allclose(reduced["NIRv"], full["NIRv"], atol=1e-3)
+
+
+def test_Pipeline_brdf():
+    rng = np.random.default_rng(0)
+    shape = (12, 9)
+    bands = {
+        name: rng.integers(8000, 20000, size=shape, dtype=np.uint16)
+        for name in ["SR_B2", "SR_B3", "SR_B4", "SR_B5", "SR_B6", "SR_B7"]
+    }
+    corners = BRDFCorrect.footprintCorners(
+        [(-120.2, 37.1), (-118.0, 36.7), (-118.4, 35.0), (-120.6, 35.4)]
+    )
+    geometry = {
+        "lon": np.linspace(-120.4, -118.2, shape[1])[np.newaxis, :],
+        "lat": np.linspace(36.9, 35.2, shape[0])[:, np.newaxis],
+        "time_start": 1593619200000,
+        "corners": corners,
+    }
+
+    # the c-factor scales reflectance, not the raw DNs and the scale offset
+    scale, offset = Scale.getScaleParams("Landsat8")
+    scaled = {
+        name: Scale.scaleLocal(band, scale, offset) for name, band in bands.items()
+    }
+    kernels = BRDFCorrect.kernelGrids(shape=shape, **geometry)
+    coefficients = BRDFCorrect.getCoefficients("Landsat8")
+    expected = BRDFCorrect.correctRows(scaled, kernels, coefficients)
+
+    stages = ["brdf", "scale"]
+    outputs = Pipeline("Landsat8", stages, "local").run(
+        bands, geometry=geometry, block_rows=5
+    )
+    for name, band in expected.items():
+        assert np.allclose(outputs[name], band, atol=1e-6)
+
+    reduced = Pipeline("Landsat8", stages, "local", dtype=np.int16).run(
+        bands, geometry=geometry, block_rows=5
+    )
+    assert reduced["SR_B4"].dtype == np.int16
+    assert np.allclose(reduced["SR_B4"] / 10000, expected["SR_B4"], atol=2e-4)
+
+
+def test_Pipeline_runRaster(tmp_path):
+    rasterio = pytest.importorskip("rasterio")
+    rng = np.random.default_rng(0)
+    names = ["SR_B2", "SR_B3", "SR_B4", "SR_B5", "SR_B6", "SR_B7"]
+    data = rng.integers(8000, 20000, size=(len(names), 16, 10), dtype=np.uint16)
+    input_path = str(tmp_path / "scene.tif")
+    profile = dict(driver="GTiff", width=10, height=16, count=len(names))
+    with rasterio.open(input_path, "w", dtype="uint16", **profile) as dst:
+        dst.write(data)
+        dst.descriptions = tuple(names)
+    bands = dict(zip(names, data))
+
+    stages = ["scale", "nirv", "unmix"]
+    outputs = ["SR_B4", "NIRv", "Soil", "RMSE"]
+    pipeline = Pipeline("Landsat8", stages, "local", SoilPVNPV, n=2, dtype=np.int16)
+    expected = pipeline.run(bands, outputs=outputs)
+    paths = pipeline.runRaster(
+        input_path, str(tmp_path / "out.tif"), outputs=outputs, block_rows=5
+    )
+    assert sorted(paths.values()) == [["NIRv", "Soil", "RMSE"], ["SR_B4"]]
+
+    written = dict()
+    for path, names in paths.items():
+        with rasterio.open(path) as src:
+            written.update(zip(names, src.read()))
+    assert written["SR_B4"].dtype == np.int16
+    assert np.array_equal(written["SR_B4"], expected["SR_B4"])
+    for name in ["NIRv", "Soil", "RMSE"]:
+        assert written[name].dtype == np.float32
+        assert np.allclose(written[name], expected[name], equal_nan=True)
+
+
+def test_Pipeline_runRaster_unnamed(tmp_path):
+    rasterio = pytest.importorskip("rasterio")
+    data = np.full((6, 4, 3), 10000, dtype=np.uint16)
+    input_path = str(tmp_path / "scene.tif")
+    profile = dict(driver="GTiff", width=3, height=4, count=6, dtype="uint16")
+    with rasterio.open(input_path, "w", **profile) as dst:
+        dst.write(data)
+
+    pipeline = Pipeline("Landsat8", ["scale"], "local")
+    paths = pipeline.runRaster(input_path, str(tmp_path / "out.tif"))
+    assert list(paths.values()) == [pipeline.bands]
@@ -0,0 +1,32 @@
+from earthlib import profiling
+
+
+def test_profiling():
+    profiling.reset()
+    function = profiling.instrument(len, "test.len")
+    assert function is len
+    with profiling.timer("test.disabled"):
+        profiling.count("test.disabled")
+    assert profiling.summary()["counters"] == {}
+
+    profiling.enable()
+    try:
+        with profiling.timer("test.stage"):
+            profiling.count("test.cache.hits", 3)
+            profiling.count("test.cache.misses")
+            profiling.count("test.pixels", 10)
+            profiling.count("test.masked", 4)
+        assert profiling.instrument(len, "test.len")([1, 2]) == 2
+    finally:
+        profiling.disable()
+
+    summary = profiling.summary()
+    assert summary["timers"]["test.stage"]["count"] == 1
+    assert summary["timers"]["test.len"]["count"] == 1
+    assert summary["rates"]["test.cache.hit_rate"] == 0.75
+    assert summary["rates"]["test.masked_fraction"] == 0.4
+    assert "earthlib_test_cache_hits_total 3" in profiling.prometheus()
+
+    events = profiling.chromeTrace()["traceEvents"]
+    assert [event["name"] for event in events] == ["test.stage", "test.len"]
+    profiling.reset()
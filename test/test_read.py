@@ -1,6 +1,10 @@
 import random
+import re
+
+import numpy as np
 
 from earthlib import read
+from earthlib.config import endmember_path
 
 
 def test_Spectra():
@@ -23,3 +27,86 @@ def test_check_file():
     random_str = "{num:06d}.xyz".format(num=random.randint(1e6, 1e7 - 1))
     assert read.check_file(__file__)
     assert not read.check_file(random_str)
+
+
+def test_spectralLibrary():
+    s = read.endmembers()
+    assert isinstance(s.spectra, np.memmap)
+    assert s.spectra.shape == (len(s.names), len(s.band_centers))
+    assert s.spectra.dtype == np.float32
+    assert s.band_unit == "Micrometers"
+
+    header = read.readEnviHeader(endmember_path[:-4] + ".hdr")
+    assert int(header["samples"]) == len(s.band_centers)
+    assert header["spectra names"] == s.names
+
+    # edits to one read's names don't leak into later reads of the same file
+    s.names[0] = "edited"
+    assert read.endmembers().names[0] == header["spectra names"][0]
+    header = read.readEnviHeader(endmember_path[:-4] + ".hdr")
+    assert header["spectra names"][0] != "edited"
+
+
+def test_SpectralLibraryWriter(tmp_path):
+    data = np.random.default_rng(0).uniform(0, 1, size=(10, 2151))
+    s = read.Spectra(data=data)
+    s.names = [f"spectrum {i}" for i in range(10)]
+    path = str(tmp_path / "subset.sli")
+    s.write_sli(path, row_inds=[1, 3, 5], spectral_inds=np.arange(0, 2151, 10))
+
+    subset = read.spectralLibrary(path)
+    assert subset.spectra.shape == (3, 216)
+    assert subset.names == ["spectrum 1", "spectrum 3", "spectrum 5"]
+    assert np.allclose(subset.spectra, data[[1, 3, 5]][:, ::10].astype(np.float32))
+
+    path = str(tmp_path / "batches")
+    with read.SpectralLibraryWriter(path, s.band_centers) as writer:
+        writer.append(data[:4])
+        writer.append(data[4:])
+
+    batches = read.spectralLibrary(path + ".sli")
+    assert batches.spectra.shape == (10, 2151)
+    assert batches.names[-1] == "Spectrum 9"
+
+    # libraries without wavelengths fall back to the default asd band centers
+    hdr = tmp_path / "batches.hdr"
+    hdr.write_text(re.sub(r"wavelength = \{.*?\}", "", hdr.read_text(), flags=re.S))
+    unlabeled = read.spectralLibrary(path + ".sli")
+    assert np.array_equal(unlabeled.band_centers, np.arange(350, 2501))
+
+
+def test_usgs(tmp_path):
+    header = [
+        "Name: test spectrum",
+        "X Units: Wavelength (micrometers)",
+        "Y Units: Reflectance (percent)",
+        "First X Value: 2.5",
+        "Number of X Values: 3",
+    ]
+    values = [(2.5, 30), (1.0, 20), (0.5, 10)]
+    for i, scale in enumerate([1, 2]):
+        rows = [f"{wl} {scale * refl}" for wl, refl in values]
+        (tmp_path / f"spectrum{i}.txt").write_text("\n".join(header + rows))
+
+    s = read.usgs(str(tmp_path / "spectrum0.txt"))
+    assert s.names == ["test spectrum"]
+    assert s.band_unit == "Nanometers"
+    assert np.allclose(s.band_centers, [500, 1000, 2500])
+    assert np.allclose(s.spectra, [[0.1, 0.2, 0.3]])
+
+    s = read.readDirectory(str(tmp_path), fmt="usgs")
+    assert s.spectra.shape == (2, 3)
+    assert np.allclose(s.spectra[1], [0.2, 0.4, 0.6])
+
+
+def test_bn():
+    data = np.random.default_rng(0).uniform(0, 1, size=(10, 2151))
+    s = read.Spectra(data=data.copy())
+    s.bn()
+    assert np.allclose(np.linalg.norm(s.spectra, axis=1), 1)
+    assert np.allclose(s.spectra, data / np.linalg.norm(data, axis=1, keepdims=True))
+
+    s = read.Spectra(data=data.copy())
+    s.bn(inds=[0, 1, 2])
+    assert s.spectra.shape == (10, 3)
+    assert len(s.band_centers) == 3
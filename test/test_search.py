@@ -0,0 +1,37 @@
+import numpy as np
+
+from earthlib import search
+
+
+def test_SpectralIndex():
+    rng = np.random.default_rng(0)
+    spectra = rng.uniform(0.05, 0.6, size=(500, 6))
+    pixels = rng.uniform(0.05, 0.6, size=(40, 6))
+
+    units = spectra / np.linalg.norm(spectra, axis=1, keepdims=True)
+    queries = pixels / np.linalg.norm(pixels, axis=1, keepdims=True)
+    angles = np.arccos(np.clip(queries @ units.T, -1, 1))
+    expected = np.argsort(angles, axis=1)[:, :5]
+
+    index = search.SpectralIndex(spectra, n_lists=0)
+    distances, indices = index.query(pixels, k=5)
+    assert np.array_equal(indices, expected)
+    assert np.allclose(distances, np.sort(angles, axis=1)[:, :5], atol=1e-3)
+
+    # probing every cluster returns the exhaustive results
+    clustered = search.SpectralIndex(spectra, n_lists=10, n_probe=10, seed=0)
+    assert np.array_equal(clustered.query(pixels, k=5)[1], expected)
+
+
+def test_pruneLibrary():
+    rng = np.random.default_rng(0)
+    spectra = rng.uniform(0.05, 0.6, size=(60, 6))
+    spectra[30] = spectra[3] * 1.5
+    labels = np.repeat(["soil", "vegetation"], 30)
+
+    kept = search.deduplicate(spectra)
+    assert 3 in kept and 30 not in kept
+
+    pruned = search.pruneLibrary(spectra, labels, n=5)
+    assert len(pruned) == 10 and 30 not in pruned
+    assert set(labels[pruned[:5]]) == {"soil"}
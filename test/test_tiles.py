@@ -0,0 +1,62 @@
+import threading
+import time
+
+import numpy as np
+import pytest
+
+from earthlib import tiles
+
+
+def test_blockWindows():
+    windows = tiles.blockWindows((5, 7), (2, 3))
+    assert len(windows) == 9
+    assert windows[-1] == (4, 6, 1, 1)
+
+    covered = np.zeros((5, 7), dtype=int)
+    for window in windows:
+        covered[tiles.windowSlices(window)] += 1
+    assert (covered == 1).all()
+
+
+def test_TileScheduler():
+    lock = threading.Lock()
+    state = {"in_flight": 0, "peak": 0}
+
+    def process(window):
+        with lock:
+            state["in_flight"] += 1
+            state["peak"] = max(state["peak"], state["in_flight"])
+        time.sleep(0.001 * (window[0] % 3))
+        return window[0]
+
+    written = list()
+
+    def write(window, result):
+        written.append(result)
+        with lock:
+            state["in_flight"] -= 1
+
+    windows = tiles.stripWindows((40, 3), 2)
+    tiles.TileScheduler(n_threads=4, max_in_flight=3).run(process, write, windows)
+    assert written == list(range(0, 40, 2))
+    assert state["peak"] <= 3
+
+
+def test_processRaster(tmp_path):
+    rasterio = pytest.importorskip("rasterio")
+    input_path = str(tmp_path / "input.tif")
+    profile = dict(driver="GTiff", width=6, height=4, count=2, dtype="int16")
+    with rasterio.open(input_path, "w", nodata=0, compress="lzw", **profile) as dst:
+        dst.write(np.arange(48, dtype=np.int16).reshape((2, 4, 6)))
+
+    def ratio(tile, window):
+        return {"ratio": tile["a"] / (tile["b"] + 1)}
+
+    output_path = str(tmp_path / "output.tif")
+    with pytest.raises(ValueError):
+        tiles.processRaster(input_path, output_path, ratio, ["ratio"])
+
+    tiles.processRaster(input_path, output_path, ratio, ["ratio"], ["a", "b"])
+    with rasterio.open(output_path) as src:
+        assert src.dtypes == ("float32",) and np.isnan(src.nodata)
+        assert src.compression is None
@@ -1,6 +1,9 @@
+import os
 import random
+import shutil
 
 import ee
+import numpy as np
 
 from earthlib import utils
 
@@ -41,6 +44,10 @@ def test_getScaler():
 def test_getBands():
     assert band in utils.getBands(sensor)
 
+    # returned lists don't share state with the sensor catalog
+    utils.getBands(sensor).remove(band)
+    assert band in utils.getBands(sensor)
+
 
 def test_getBandIndices():
     assert 6 in utils.getBandIndices([band], sensor)
@@ -53,3 +60,86 @@ def test_selectSpectra():
     some_spectra = utils.selectSpectra(dtype, sensor, n)
     assert len(all_spectra) > len(some_spectra)
     assert len(some_spectra) == n
+
+    # seedless draws follow the global random state
+    np.random.seed(0)
+    first = utils.selectSpectra(dtype, sensor, n)
+    np.random.seed(0)
+    assert np.array_equal(first, utils.selectSpectra(dtype, sensor, n))
+
+
+def test_randomGenerator():
+    rng = utils.randomGenerator(0)
+    assert utils.randomGenerator(rng) is rng
+
+    same = [utils.randomGenerator(0, key="bare").random(8) for _ in range(2)]
+    other = utils.randomGenerator(0, key="npv").random(8)
+    assert np.array_equal(*same)
+    assert not np.allclose(same[0], other)
+
+
+def test_sampleEndmembers():
+    n = 12
+    types = [dtype, "bare", "npv"]
+    spectra = utils.sampleEndmembers(types, sensor, n, seed=42)
+    assert spectra.shape == (n, len(types), len(utils.getBands(sensor)))
+    assert np.array_equal(spectra, utils.sampleEndmembers(types, sensor, n, seed=42))
+
+    # the unmixing modules share the same sampling, returned as numpy locally
+    local = utils.unmixingEndmembers(types, sensor, None, n, "local", seed=42)
+    assert np.array_equal(local, spectra)
+
+    # stratified draws cycle through every source in the class
+    stratified = utils.sampleEndmembers(["bare"], sensor, n, seed=42, stratify="SOURCE")
+    library = utils.getEndmemberLibrary()
+    subset = library.subset("bare", utils.sensorResponse(sensor))
+    sources = library.metadata["SOURCE"].values[library.typeIndices("bare")]
+    drawn = [sources[np.all(subset == draw, axis=1)][0] for draw in stratified[:, 0]]
+    assert set(drawn) == set(sources)
+
+
+
+def test_getEndmemberLibrary(tmp_path):
+    # copy the package library so its modification time can be changed
+    path = str(tmp_path / "spectra.sli")
+    base = os.path.splitext(utils.endmember_path)[0]
+    for ext in [".sli", ".hdr", ".csv"]:
+        shutil.copy(base + ext, str(tmp_path / "spectra") + ext)
+
+    library = utils.getEndmemberLibrary(path)
+    assert utils.getEndmemberLibrary(path) is library
+
+    # a modified file is reloaded and replaces the stale copy
+    mtime = os.path.getmtime(path)
+    os.utime(path, (mtime + 10, mtime + 10))
+    reloaded = utils.getEndmemberLibrary(path)
+    assert reloaded is not library
+    key = os.path.realpath(path)
+    assert utils._library_cache[key] == (mtime + 10, reloaded)
+    assert len(utils._library_cache) <= utils.LIBRARY_CACHE_SIZE
+
+
+def test_gaussianResponse():
+    wavelengths = np.arange(0.4, 2.46, 0.01)
+    centers = np.array(utils.collections[sensor]["band_centers"])
+    widths = np.array(utils.collections[sensor]["band_widths"])
+    response = utils.gaussianResponse(wavelengths, centers, widths)
+    assert response.shape == (len(centers), len(wavelengths))
+    assert np.allclose(response.sum(axis=1), 1)
+
+    flat = np.full((3, len(wavelengths)), 0.25)
+    assert np.allclose(utils.resampleSpectra(flat, response), 0.25)
+
+    # bands narrower than the wavelength step interpolate between neighbours
+    narrow = utils.gaussianResponse(wavelengths, np.array([0.503, 0.39]), [0.001] * 2)
+    assert np.allclose(narrow.sum(axis=1), 1)
+    assert np.allclose(narrow[0, 10:12], [0.7, 0.3]) and narrow[1, 0] == 1
+
+
+def test_tabulatedResponse():
+    wavelengths = np.arange(0.4, 2.46, 0.01)
+    table_wavelengths = np.array([0.5, 0.55, 0.6])
+    boxcar = np.array([[1.0, 1.0, 1.0]])
+    response = utils.tabulatedResponse(wavelengths, table_wavelengths, boxcar)
+    assert np.allclose(response.sum(axis=1), 1)
+    assert response[0, wavelengths < 0.49].sum() == 0
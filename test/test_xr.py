@@ -0,0 +1,53 @@
+import numpy as np
+import pytest
+
+xr = pytest.importorskip("xarray")
+pytest.importorskip("dask")
+
+import earthlib.xr  # noqa: F401, E402
+from earthlib import CloudMask, NIRv  # noqa: E402
+
+
+def test_opening():
+    rng = np.random.default_rng(0)
+    mask = xr.DataArray(rng.random((2, 40, 36)) > 0.3, dims=("time", "y", "x"))
+
+    opened = mask.chunk({"y": 13, "x": 11}).earthlib.opening(radius=2).compute()
+    for t in range(2):
+        expected = CloudMask.openingLocal(mask.values[t], radius=2)
+        assert np.array_equal(opened.values[t], expected)
+
+    # chunks narrower than the halo are merged before overlapping
+    narrow = mask.chunk({"y": 3, "x": 36}).earthlib.opening(radius=2).compute()
+    assert np.array_equal(narrow.values, opened.values)
+    assert earthlib.xr.haloChunks((3, 3, 3, 3), 4) == (4, 4, 4)
+
+
+def test_nirv():
+    rng = np.random.default_rng(0)
+    values = rng.uniform(0.05, 0.5, size=(3, 6, 8, 8)).astype(np.float32)
+    bands = ["SR_B2", "SR_B3", "SR_B4", "SR_B5", "SR_B6", "SR_B7"]
+    stack = xr.DataArray(
+        values, dims=("time", "band", "y", "x"), coords={"band": bands}
+    ).chunk({"time": 1, "y": 4})
+
+    nirv = stack.earthlib.nirv("Landsat8").compute()
+    assert nirv.dims == ("time", "y", "x")
+    assert np.allclose(nirv.values, NIRv.NIRvLocal(values[:, 2], values[:, 3]))
+
+
+def test_cloudMask():
+    rng = np.random.default_rng(0)
+    values = rng.integers(0, 1 << 6, size=(2, 2, 6, 5), dtype=np.uint16)
+    values[:, 1] = 0
+    bands = ["QA_PIXEL", "QA_RADSAT"]
+    stack = xr.DataArray(
+        values, dims=("time", "band", "y", "x"), coords={"band": bands}
+    ).chunk({"band": 1, "y": 3})
+
+    # the qa bands are split across chunks, and merged before masking
+    mask = stack.earthlib.cloudMask("Landsat8").compute()
+    for t in range(2):
+        qa = dict(zip(bands, values[t]))
+        expected = CloudMask.qaMaskLocal(qa, "Landsat8", pack=False)
+        assert np.array_equal(mask.values[t], expected)